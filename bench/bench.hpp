@@ -0,0 +1,150 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef SSHASH_BENCH_HPP
+#define SSHASH_BENCH_HPP
+
+#include <stdint.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <regex>
+#include <ostream>
+
+namespace sshash {
+namespace bench {
+
+// Keep the compiler from optimizing away a value
+template <typename T>
+inline void keep(const T& v)
+{
+	__asm__ __volatile__("" : : "g"(&v) : "memory");
+}
+
+inline uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Benchmark result
+struct result {
+	std::string name;
+	double      ns_per_op;   // median over the repetitions
+	double      min_ns;      // fastest repetition
+	uint64_t    iterations;  // per repetition
+	double      bytes_per_op; // for throughput (0 if not applicable)
+};
+
+// Minimal benchmark runner.
+// Each benchmark is calibrated so that a repetition takes at least min_time,
+// then repeated a few times. The median time per operation is reported.
+class runner {
+public:
+	runner(const std::string& filter, double min_time_ms, unsigned int reps) :
+		_filter(filter.empty() ? ".*" : filter), _min_ns(min_time_ms * 1e6), _reps(reps ? reps : 1)
+	{}
+
+	// Benchmark is selected by the filter
+	bool enabled(const std::string& name) const { return std::regex_search(name, _filter); }
+
+	/**
+	 * Run a benchmark
+	 * @param name benchmark name
+	 * @param f callable, f(n) runs n operations
+	 * @param bytes_per_op bytes processed per operation (for MB/s)
+	 */
+	template <typename F>
+	void run(const std::string& name, F f, double bytes_per_op = 0)
+	{
+		if (!enabled(name))
+			return;
+
+		// Calibrate
+		uint64_t n = 1, t = 0;
+		for (;;) {
+			uint64_t t0 = now_ns();
+			f(n);
+			t = now_ns() - t0;
+			if (t >= _min_ns || n >= (1ull << 40))
+				break;
+			double scale = t ? _min_ns * 1.2 / t : 100;
+			n = std::max<uint64_t>(n + 1, std::min<double>(n * scale, n * 100.0));
+		}
+
+		std::vector<double> v;
+		for (unsigned int r = 0; r < _reps; r++) {
+			uint64_t t0 = now_ns();
+			f(n);
+			v.push_back((double) (now_ns() - t0) / n);
+		}
+		add(name, v, n, bytes_per_op);
+	}
+
+	/**
+	 * Add a result measured by the caller
+	 * @param name benchmark name
+	 * @param ns time per operation for each repetition
+	 * @param iterations operations per repetition
+	 * @param bytes_per_op bytes processed per operation (for MB/s)
+	 */
+	void add(const std::string& name, std::vector<double> ns, uint64_t iterations, double bytes_per_op = 0);
+
+	const std::vector<result>& results() const { return _results; }
+
+	// Print results as a JSON document
+	void dump_json(std::ostream& os) const;
+
+	// Print results in human readable form
+	void dump_text(std::ostream& os) const;
+
+	/**
+	 * Compare results against a baseline (JSON output of an earlier run)
+	 * @param file baseline file
+	 * @param threshold slowdown (in percent) that counts as a regression
+	 * @param os report output
+	 * @return false if anything regressed or the baseline cannot be loaded
+	 */
+	bool compare(const std::string& file, double threshold, std::ostream& os) const;
+
+private:
+	std::regex          _filter;
+	double              _min_ns;
+	unsigned int        _reps;
+	std::vector<result> _results;
+};
+
+} // namespace bench
+} // namespace sshash
+
+#endif // SSHASH_BENCH_HPP
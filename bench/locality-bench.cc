@@ -0,0 +1,240 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+// Locality of the sensitive strings (see SSHASH_STR_PLACEMENT).
+// Runs a logging heavy workload: every record formats a plain format string (in .rodata)
+// with a sensitive string (placed by the linker script this binary is linked with),
+// between bits of application work that keep evicting the caches and the TLB.
+// The same objects are linked once per placement, the binaries only differ in the layout.
+// Reports time per record and the cache and TLB misses (hardware counters via
+// perf_event_open, if available) per 1000 records, and how many pages the strings span.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include <algorithm>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+static po::variables_map optmap;
+
+using sshash::bench::keep;
+using sshash::bench::now_ns;
+
+#ifndef SSHASH_LOCALITY_PLACEMENT
+#define SSHASH_LOCALITY_PLACEMENT "unknown"
+#endif
+
+// Log call sites (generated by bench/CMakeLists.txt)
+extern const unsigned int locality_nsites;
+void locality_sites(const char **fmt, const char **str);
+
+// Hardware counter
+struct counter {
+	const char *name;
+	uint32_t    type;
+	uint64_t    config;
+	int         fd;
+	uint64_t    value;
+};
+
+static uint64_t cache_event(uint64_t cache)
+{
+	return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+static counter counters[] = {
+	{ "dTLB",  PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_DTLB), -1, 0 },
+	{ "iTLB",  PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_ITLB), -1, 0 },
+	{ "L1d",   PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_L1D),  -1, 0 },
+	{ "LLC",   PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_LL),   -1, 0 },
+};
+static const unsigned int ncounters = sizeof(counters) / sizeof(counters[0]);
+
+// Counts user space events of this thread, returns -1 if not available
+static int perf_open(uint32_t type, uint64_t config)
+{
+	struct perf_event_attr a;
+	memset(&a, 0, sizeof(a));
+	a.size   = sizeof(a);
+	a.type   = type;
+	a.config = config;
+	a.disabled       = 1;
+	a.exclude_kernel = 1;
+	a.exclude_hv     = 1;
+	return syscall(SYS_perf_event_open, &a, 0, -1, -1, 0);
+}
+
+static void perf_ctl(unsigned long op)
+{
+	for (auto &c : counters)
+		if (c.fd >= 0)
+			ioctl(c.fd, op, 0);
+}
+
+// Pages covered by the strings
+static void add_pages(std::set<uintptr_t>& pages, const char *s)
+{
+	uintptr_t b = (uintptr_t) s, e = b + strlen(s);
+	for (uintptr_t p = b >> 12; p <= e >> 12; p++)
+		pages.insert(p);
+}
+
+int main(int argc, char *argv[])
+{
+	// **** Parse command line arguments ****
+	po::options_description optdesc("locality-bench -- locality of the sensitive strings (placement: " SSHASH_LOCALITY_PLACEMENT ")\n"
+				"Usage: locality-bench-<placement> [options]\n"
+				"Options");
+	optdesc.add_options()
+		("help", "Print this message")
+		("records", po::value<unsigned int>()->default_value(2000000), "Number of log records per repetition")
+		("reps",    po::value<unsigned int>()->default_value(3), "Number of repetitions (the best one is reported)")
+		("hot",     po::value<unsigned int>()->default_value(80), "Percent of the records logged from the hot call sites (1/16 of all)")
+		("work-mb", po::value<unsigned int>()->default_value(64), "Size of the application data touched between records, in MB")
+		("work",    po::value<unsigned int>()->default_value(8), "Cache lines of application data touched per record")
+		("header",  "Print the column names");
+
+	po::store(po::command_line_parser(argc, argv).options(optdesc).run(), optmap);
+	po::notify(optmap);
+
+	if (optmap.count("help")) {
+		std::cout << optdesc << std::endl;
+		return 1;
+	}
+
+	const unsigned int nrecords = optmap["records"].as<unsigned int>();
+	const unsigned int reps     = std::max(1u, optmap["reps"].as<unsigned int>());
+	const unsigned int hot      = std::min(100u, optmap["hot"].as<unsigned int>());
+	const unsigned int nwork    = optmap["work"].as<unsigned int>();
+	const size_t       work_size = std::max<size_t>(1, optmap["work-mb"].as<unsigned int>()) << 20;
+
+	std::vector<const char *> fmt(locality_nsites), str(locality_nsites);
+	locality_sites(fmt.data(), str.data());
+
+	// Call sites of the records (generated up front, same sequence for all placements)
+	const unsigned int nhot = std::max(1u, locality_nsites / 16);
+	std::vector<uint32_t> seq(nrecords);
+	uint64_t x = 88172645463325252ull;
+	for (auto &s : seq) {
+		x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+		s = (x >> 32) % 100 < hot ? (x % nhot) : (x % locality_nsites);
+	}
+
+	std::vector<char> work(work_size, 1);
+	const unsigned int slots = 256, slot_size = 256;
+	std::vector<char> ring(slots * slot_size);
+
+	bool have_perf = false;
+	for (auto &c : counters) {
+		c.fd = perf_open(c.type, c.config);
+		have_perf |= c.fd >= 0;
+	}
+
+	double best_ns = 0;
+	for (unsigned int r = 0; r < reps; r++) {
+		uint64_t w = x;
+		unsigned int sum = 0;
+
+		perf_ctl(PERF_EVENT_IOC_RESET);
+		perf_ctl(PERF_EVENT_IOC_ENABLE);
+		uint64_t t0 = now_ns();
+		for (unsigned int i = 0; i < nrecords; i++) {
+			// Application work
+			for (unsigned int k = 0; k < nwork; k++) {
+				w ^= w << 13; w ^= w >> 7; w ^= w << 17;
+				sum += work[w % work_size]++;
+			}
+			// Log record
+			uint32_t s = seq[i];
+			snprintf(&ring[(i % slots) * slot_size], slot_size, fmt[s], str[s], i);
+		}
+		uint64_t t = now_ns() - t0;
+		perf_ctl(PERF_EVENT_IOC_DISABLE);
+		keep(sum);
+		keep(ring);
+
+		double ns = (double) t / nrecords;
+		if (r && ns >= best_ns)
+			continue;
+		best_ns = ns;
+		for (auto &c : counters) {
+			c.value = 0;
+			if (c.fd >= 0 && read(c.fd, &c.value, sizeof(c.value)) != sizeof(c.value))
+				c.value = 0;
+		}
+	}
+
+	// Layout
+	std::set<uintptr_t> str_pages, fmt_pages;
+	for (unsigned int i = 0; i < locality_nsites; i++) {
+		add_pages(str_pages, str[i]);
+		add_pages(fmt_pages, fmt[i]);
+	}
+	unsigned int shared = 0;
+	for (auto p : str_pages)
+		shared += fmt_pages.count(p);
+
+	if (optmap.count("header")) {
+		printf("%-14s %10s", "placement", "ns/record");
+		for (auto &c : counters)
+			printf(" %10s", (std::string(c.name) + "/krec").c_str());
+		printf(" %10s %10s %10s\n", "str-pages", "fmt-pages", "shared");
+	}
+
+	printf("%-14s %10.1f", SSHASH_LOCALITY_PLACEMENT, best_ns);
+	for (auto &c : counters) {
+		if (c.fd >= 0)
+			printf(" %10.2f", c.value * 1000.0 / nrecords);
+		else
+			printf(" %10s", "n/a");
+		if (c.fd >= 0)
+			close(c.fd);
+	}
+	printf(" %10zu %10zu %10u\n", str_pages.size(), fmt_pages.size(), shared);
+
+	if (!have_perf)
+		fprintf(stderr, "locality-bench: hardware counters are not available (see /proc/sys/kernel/perf_event_paranoid)\n");
+
+	return 0;
+}
@@ -0,0 +1,141 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdio.h>
+
+#include <iostream>
+#include <map>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+#include "bench.hpp"
+
+namespace sshash {
+namespace bench {
+
+void runner::add(const std::string& name, std::vector<double> ns, uint64_t iterations, double bytes_per_op)
+{
+	if (ns.empty())
+		return;
+	std::sort(ns.begin(), ns.end());
+
+	result r;
+	r.name         = name;
+	r.ns_per_op    = ns[ns.size() / 2];
+	r.min_ns       = ns[0];
+	r.iterations   = iterations;
+	r.bytes_per_op = bytes_per_op;
+	_results.push_back(r);
+
+	// Progress
+	char buf[256];
+	snprintf(buf, sizeof(buf), "%-40s %14.1f ns/op", name.c_str(), r.ns_per_op);
+	std::cerr << buf << "\n";
+}
+
+static double mb_per_s(const result& r)
+{
+	return r.bytes_per_op && r.ns_per_op ? r.bytes_per_op * 1e3 / r.ns_per_op : 0;
+}
+
+void runner::dump_json(std::ostream& os) const
+{
+	char buf[512];
+	os << "{\n  \"benchmarks\": [\n";
+	for (size_t i = 0; i < _results.size(); i++) {
+		const result &r = _results[i];
+		snprintf(buf, sizeof(buf), "    {\"name\": \"%s\", \"ns_per_op\": %.3f, \"min_ns_per_op\": %.3f, "
+			"\"iterations\": %llu, \"mb_per_s\": %.3f}%s\n",
+			r.name.c_str(), r.ns_per_op, r.min_ns, (unsigned long long) r.iterations, mb_per_s(r),
+			i + 1 < _results.size() ? "," : "");
+		os << buf;
+	}
+	os << "  ]\n}\n";
+}
+
+void runner::dump_text(std::ostream& os) const
+{
+	char buf[256];
+	snprintf(buf, sizeof(buf), "%-40s %14s %14s %12s\n", "benchmark", "ns/op", "min ns/op", "MB/s");
+	os << buf;
+	for (auto &r : _results) {
+		snprintf(buf, sizeof(buf), "%-40s %14.1f %14.1f", r.name.c_str(), r.ns_per_op, r.min_ns);
+		os << buf;
+		if (r.bytes_per_op)
+			snprintf(buf, sizeof(buf), " %12.1f\n", mb_per_s(r));
+		else
+			snprintf(buf, sizeof(buf), " %12s\n", "-");
+		os << buf;
+	}
+}
+
+bool runner::compare(const std::string& file, double threshold, std::ostream& os) const
+{
+	namespace pt = boost::property_tree;
+
+	std::map<std::string, double> base;
+	try {
+		pt::ptree tree;
+		pt::read_json(file, tree);
+		for (auto &b : tree.get_child("benchmarks"))
+			base[b.second.get<std::string>("name")] = b.second.get<double>("ns_per_op");
+	} catch (std::exception &e) {
+		std::cerr << "failed to load baseline: " << e.what() << "\n";
+		return false;
+	}
+
+	char buf[256];
+	snprintf(buf, sizeof(buf), "%-40s %14s %14s %9s\n", "benchmark", "baseline", "ns/op", "change");
+	os << buf;
+
+	unsigned int nregress = 0;
+	for (auto &r : _results) {
+		auto it = base.find(r.name);
+		if (it == base.end()) {
+			snprintf(buf, sizeof(buf), "%-40s %14s %14.1f %9s\n", r.name.c_str(), "-", r.ns_per_op, "new");
+			os << buf;
+			continue;
+		}
+		double change = it->second ? (r.ns_per_op - it->second) * 100 / it->second : 0;
+		bool regress = change > threshold;
+		nregress += regress;
+		snprintf(buf, sizeof(buf), "%-40s %14.1f %14.1f %+8.1f%%%s\n", r.name.c_str(), it->second, r.ns_per_op,
+			change, regress ? "  REGRESSION" : "");
+		os << buf;
+	}
+
+	if (nregress)
+		os << nregress << " regression(s) over " << threshold << "%\n";
+	return !nregress;
+}
+
+} // namespace bench
+} // namespace sshash
@@ -0,0 +1,446 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "sshash/map.hpp"
+#include "sshash/resolver.hpp"
+#include "sshash/matcher.hpp"
+#include "ssfmt-compiled.hpp"
+#include "string-parser.hpp"
+#include "sha.hpp"
+#include "bench.hpp"
+
+#ifdef SSHASH_BENCH_HOGL
+#include <hogl/engine.hpp>
+#include <hogl/area.hpp>
+#include <hogl/mask.hpp>
+#include <hogl/post.hpp>
+#include <hogl/output-plainfile.hpp>
+#include "ssformat.hpp"
+#endif
+
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+static po::variables_map optmap;
+
+using sshash::bench::runner;
+using sshash::bench::keep;
+using sshash::bench::now_ns;
+
+extern char **environ;
+
+// Scratch directory for files written by the benchmarks
+static std::string tmpdir;
+
+// Test data: strings, their digests and a map with both
+struct bench_data {
+	std::vector<std::string> strs;
+	std::vector<std::string> digests;
+	sshash::map map;
+
+	bench_data(unsigned int n)
+	{
+		std::mt19937 rng(42);
+		static const char alpha[] = "abcdefghijklmnopqrstuvwxyz ABCDEFGHIJKLMNOPQRSTUVWXYZ 0123456789";
+		sshash::sha sha(8);
+		for (unsigned int i = 0; i < n; i++) {
+			std::string s = "sensitive " + std::to_string(i) + " ";
+			size_t len = 8 + rng() % 40;
+			while (s.size() < len)
+				s += alpha[rng() % (sizeof(alpha) - 1)];
+
+			std::string d;
+			sha.digest(d, s);
+			if (!map.update(d, s, "sshash-bench"))
+				continue;
+			strs.push_back(s);
+			digests.push_back(d);
+		}
+	}
+};
+
+static void bench_sha(runner& r)
+{
+	sshash::sha sha(8);
+	std::string out;
+	for (size_t len : { 16, 64, 256 }) {
+		std::string in(len, 'x');
+		r.run("sha/digest-" + std::to_string(len), [&](uint64_t n) {
+			for (uint64_t i = 0; i < n; i++) {
+				in[i % len] = 'a' + i % 26;
+				sha.digest(out, in);
+				keep(out);
+			}
+		}, len);
+	}
+}
+
+static void bench_map(runner& r, const bench_data& d)
+{
+	const std::string file = tmpdir + "/bench.map";
+	const size_t nstrs = d.strs.size();
+
+	r.run("map/update-" + std::to_string(nstrs), [&](uint64_t n) {
+		for (uint64_t i = 0; i < n; i++) {
+			sshash::map m;
+			for (size_t k = 0; k < nstrs; k++)
+				m.update(d.digests[k], d.strs[k], "sshash-bench");
+			keep(m);
+		}
+	});
+
+	// Lookup the way sshash-elf checks for collisions
+	r.run("map/get", [&](uint64_t n) {
+		for (uint64_t i = 0; i < n; i++) {
+			std::string s = d.map.get<std::string>(d.digests[i % nstrs] + ".str");
+			keep(s);
+		}
+	});
+
+	sshash::map m = d.map;
+	r.run("map/save-" + std::to_string(nstrs), [&](uint64_t n) {
+		for (uint64_t i = 0; i < n; i++)
+			m.save(file);
+	});
+
+	r.run("map/load-" + std::to_string(nstrs), [&](uint64_t n) {
+		for (uint64_t i = 0; i < n; i++) {
+			sshash::map l;
+			l.load(file);
+			keep(l);
+		}
+	});
+
+	unlink(file.c_str());
+}
+
+static void bench_resolver(runner& r, const bench_data& d)
+{
+	sshash::resolver res;
+	res.publish(d.map);
+	sshash::resolver::reader rd(res);
+	const size_t nstrs = d.digests.size();
+
+	r.run("resolver/lookup-hit", [&](uint64_t n) {
+		for (uint64_t i = 0; i < n; i++)
+			keep(rd.lookup(d.digests[i % nstrs]));
+	});
+
+	std::vector<std::string> misses;
+	for (size_t i = 0; i < 1024; i++) {
+		std::string s = d.digests[i % nstrs];
+		s[s.size() - 1] = s[s.size() - 1] == 'z' ? 'y' : 'z';
+		misses.push_back(s);
+	}
+	r.run("resolver/lookup-miss", [&](uint64_t n) {
+		for (uint64_t i = 0; i < n; i++)
+			keep(rd.lookup(misses[i % misses.size()]));
+	});
+
+	// Typical ssformat arguments: mostly plain strings
+	const char *plain[] = { "connection", "state=ready", "127.0.0.1", "ok", "Hello world" };
+	r.run("resolver/resolve-plain", [&](uint64_t n) {
+		for (uint64_t i = 0; i < n; i++)
+			keep(rd.resolve(plain[i % 5]));
+	});
+
+	// Substring replacement on a formatted line
+	std::string line = "2021-06-01 12:00:00.000 AREA:INFO user " + d.digests[1] + " key " + d.digests[2] + " done\n";
+	std::string out;
+	r.run("resolver/replace-line", [&](uint64_t n) {
+		const sshash::resolver::snapshot *s = rd.get();
+		for (uint64_t i = 0; i < n; i++) {
+			out.clear();
+			keep(s->replace(line.data(), line.size(), out));
+		}
+	}, line.size());
+}
+
+static void bench_matcher(runner& r, const bench_data& d)
+{
+	sshash::matcher m(d.map, sshash::matcher::HASH);
+	std::mt19937 rng(1);
+
+	// Log-like text, one sensitive string every 20 lines
+	std::string sparse, dense;
+	for (unsigned int i = 0; i < 20000; i++) {
+		sparse += "2021-06-01 12:00:00 INFO connection " + std::to_string(i) + " established user=";
+		sparse += i % 20 ? "guest" : d.strs[rng() % d.strs.size()];
+		sparse += "\n";
+	}
+	// Every line has two sensitive strings
+	for (unsigned int i = 0; i < 20000; i++)
+		dense += "line " + d.strs[rng() % d.strs.size()] + " and " + d.strs[rng() % d.strs.size()] + "\n";
+
+	std::string out;
+	r.run("matcher/replace-sparse", [&](uint64_t n) {
+		for (uint64_t i = 0; i < n; i++) {
+			out.clear();
+			m.replace(sparse.data(), sparse.size(), out);
+		}
+	}, sparse.size());
+	r.run("matcher/replace-dense", [&](uint64_t n) {
+		for (uint64_t i = 0; i < n; i++) {
+			out.clear();
+			m.replace(dense.data(), dense.size(), out);
+		}
+	}, dense.size());
+}
+
+static void bench_string_parser(runner& r, const bench_data& d)
+{
+	if (!r.enabled("string_parser/scan"))
+		return;
+
+	// Section with compact padding: each string is followed by NULs up to the digest length
+	std::string sect;
+	for (auto &s : d.strs) {
+		sect += s;
+		sect.append(s.size() < 8 ? 9 - s.size() : 1, '\0');
+	}
+
+	const std::string file = tmpdir + "/bench.sect";
+	int fd = open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || write(fd, sect.data(), sect.size()) != (ssize_t) sect.size()) {
+		std::cerr << file << " write failed: " << strerror(errno) << "\n";
+		if (fd >= 0)
+			close(fd);
+		return;
+	}
+
+	r.run("string_parser/scan", [&](uint64_t n) {
+		std::string str;
+		uint64_t off;
+		size_t room;
+		for (uint64_t i = 0; i < n; i++) {
+			sshash::string_parser sp(fd, 0, sect.size());
+			while (sp.next(str, off, room))
+				keep(str);
+		}
+	}, sect.size());
+
+	close(fd);
+	unlink(file.c_str());
+}
+
+static void bench_compiled_format(runner& r)
+{
+	typedef sshash::compiled_format cf;
+	cf f;
+	f.compile("conn %u rx %llu tx %llu state %s err 0x%08x");
+	cf::arg args[5];
+	args[0].cls = cf::ARG_U32; args[0].val = 12;
+	args[1].cls = cf::ARG_U64; args[1].val = 123456789;
+	args[2].cls = cf::ARG_U64; args[2].val = 987654321;
+	args[3].cls = cf::ARG_STR; args[3].str = "established";
+	args[4].cls = cf::ARG_U32; args[4].val = 0xbeef;
+
+	std::string out;
+	r.run("format/compiled-render", [&](uint64_t n) {
+		for (uint64_t i = 0; i < n; i++) {
+			out.clear();
+			args[0].val = i;
+			f.render(out, args, 5);
+			keep(out);
+		}
+	});
+}
+
+// Run sshash-elf on a fresh copy of the fixture binary
+static void bench_elf(runner& r, unsigned int reps)
+{
+	const std::string name = "elf/sshash-elf-fixture";
+	if (!r.enabled(name))
+		return;
+
+	std::ifstream in(SSHASH_BENCH_FIXTURE, std::ios::binary);
+	std::string image((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	if (image.empty()) {
+		std::cerr << SSHASH_BENCH_FIXTURE << ": failed to read fixture\n";
+		return;
+	}
+
+	const std::string elf = tmpdir + "/fixture";
+	const std::string map = tmpdir + "/fixture.map";
+	std::vector<double> v;
+	for (unsigned int i = 0; i < reps; i++) {
+		std::ofstream(elf, std::ios::binary | std::ios::trunc) << image;
+		unlink(map.c_str());
+
+		posix_spawn_file_actions_t fa;
+		posix_spawn_file_actions_init(&fa);
+		posix_spawn_file_actions_addopen(&fa, 1, "/dev/null", O_WRONLY, 0);
+
+		const char *argv[] = { SSHASH_BENCH_ELF_TOOL, "--hashmap", map.c_str(), elf.c_str(), nullptr };
+		pid_t pid;
+		int status = -1;
+		uint64_t t0 = now_ns();
+		if (!posix_spawn(&pid, argv[0], &fa, nullptr, (char **) argv, environ))
+			waitpid(pid, &status, 0);
+		uint64_t t = now_ns() - t0;
+		posix_spawn_file_actions_destroy(&fa);
+
+		if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+			std::cerr << SSHASH_BENCH_ELF_TOOL << " failed\n";
+			break;
+		}
+		v.push_back(t);
+	}
+	unlink(elf.c_str());
+	unlink(map.c_str());
+
+	if (v.size() == reps)
+		r.add(name, v, 1, image.size());
+}
+
+#ifdef SSHASH_BENCH_HOGL
+// Per-record cost of ssformat::process(), as measured by its own latency stats.
+// Records are posted through the hogl engine into an output that writes to /dev/null.
+static void bench_ssformat(runner& r, const bench_data& d, unsigned int reps)
+{
+	const std::string name = "ssformat/process";
+	if (!r.enabled(name))
+		return;
+
+	sshash::resolver res;
+	res.publish(d.map);
+
+	const unsigned int nrecords = 100000;
+	std::vector<double> v;
+	for (unsigned int i = 0; i < reps; i++) {
+		sshash::ssformat fmt(res, "fast1", false, true);
+		hogl::output_plainfile out("/dev/null", fmt);
+		hogl::activate(out);
+
+		const hogl::area *area = hogl::add_area("BENCH-AREA");
+		hogl::mask logmask(".*", 0);
+		hogl::apply_mask(logmask);
+
+		for (unsigned int k = 0; k < nrecords; k++)
+			hogl::post(area, area->INFO, hogl::arg_gstr("user %s session %u"),
+				hogl::arg_gstr(d.digests[k % d.digests.size()].c_str()), k);
+
+		hogl::deactivate();
+
+		const sshash::decode_stats &s = fmt.stats();
+		if (s.latency_count)
+			v.push_back((double) s.latency_sum / s.latency_count);
+	}
+	r.add(name, v, nrecords);
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+	// **** Parse command line arguments ****
+	po::options_description optdesc("sshash-bench -- sshash micro-benchmarks\n"
+				"Usage: sshash-bench [options]\n"
+				"Options");
+	optdesc.add_options()
+		("help", "Print this message")
+		("filter",    po::value<std::string>()->default_value(""), "Run benchmarks whose name matches this regex")
+		("json",      po::value<std::string>(), "Write results as JSON to this file (\"-\" for stdout)")
+		("baseline",  po::value<std::string>(), "Compare results against a baseline (JSON from an earlier run)")
+		("threshold", po::value<double>()->default_value(10), "Slowdown in percent that counts as a regression")
+		("min-time",  po::value<double>()->default_value(100), "Minimum time per repetition in msec")
+		("reps",      po::value<unsigned int>()->default_value(5), "Number of repetitions")
+		("strings",   po::value<unsigned int>()->default_value(20000), "Number of strings in the test map");
+
+	po::store(po::command_line_parser(argc, argv).options(optdesc).run(), optmap);
+	po::notify(optmap);
+
+	if (optmap.count("help")) {
+		std::cout << optdesc << std::endl;
+		return 1;
+	}
+
+	char tmpl[] = "/tmp/sshash-bench.XXXXXX";
+	if (!mkdtemp(tmpl)) {
+		std::cerr << "mkdtemp failed: " << strerror(errno) << "\n";
+		return 1;
+	}
+	tmpdir = tmpl;
+
+	const unsigned int reps = optmap["reps"].as<unsigned int>();
+	runner r(optmap["filter"].as<std::string>(), optmap["min-time"].as<double>(), reps);
+	bench_data d(optmap["strings"].as<unsigned int>());
+
+	bench_sha(r);
+	bench_map(r, d);
+	bench_resolver(r, d);
+	bench_matcher(r, d);
+	bench_string_parser(r, d);
+	bench_compiled_format(r);
+	bench_elf(r, reps);
+#ifdef SSHASH_BENCH_HOGL
+	bench_ssformat(r, d, reps);
+#endif
+
+	rmdir(tmpdir.c_str());
+
+	r.dump_text(std::cout);
+
+	if (optmap.count("json")) {
+		const std::string &name = optmap["json"].as<std::string>();
+		if (name == "-")
+			r.dump_json(std::cout);
+		else {
+			std::ofstream f(name);
+			r.dump_json(f);
+			if (!f) {
+				std::cerr << name << " write failed\n";
+				return 1;
+			}
+		}
+	}
+
+	if (optmap.count("baseline")) {
+		std::cout << "\n";
+		if (!r.compare(optmap["baseline"].as<std::string>(), optmap["threshold"].as<double>(), std::cout))
+			return 2;
+	}
+
+	return 0;
+}
@@ -0,0 +1,126 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef SSHASH_HASHER_HPP
+#define SSHASH_HASHER_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <ostream>
+#include <functional>
+
+#include "sshash/map.hpp"
+
+namespace sshash {
+
+// In-process ELF string hashing for build and packaging tools (libsshash-hasher).
+// Does what sshash-elf does to a file, with the map kept in memory across any
+// number of inputs: the strings in the .sshash.str sections are replaced with
+// their digests and recorded in the map. The map is only modified in memory,
+// saving it (map::save()) is up to the caller.
+// Inputs are linked ELF binaries and libraries, object files and ar archives
+// of object files (see README).
+// Not thread-safe, use one hasher (and map) per thread. A hasher runs its own
+// worker threads for large files (see options::jobs).
+class elf_hasher {
+public:
+	struct options {
+		unsigned int digest_len; // digest length (sshash-elf --minlen)
+		unsigned int jobs;       // number of worker threads for hashing
+		bool         ids;        // write the string ID table of each linked ELF (<file>.sshash-ids)
+		bool         dryrun;     // do not modify the inputs (the map is still updated)
+		std::ostream *log;       // progress messages (as printed by sshash-elf), nullptr for none
+
+		options() : digest_len(8), jobs(1), ids(false), dryrun(false), log(nullptr) {}
+	};
+
+	// Outcome of hashing one input
+	struct result {
+		std::string name;         // file name, or the name passed to hash_buffer()
+		bool        ok;
+		std::string error;        // error messages if the input failed
+		uint64_t    sections;     // .sshash.str sections processed
+		uint64_t    hashed;       // strings replaced with their digests
+		uint64_t    map_new;      // strings added to the map
+		uint64_t    map_existing; // strings that were already in the map (or already hashed)
+		map         strings;      // strings of this input: { digest: { str, elf } }
+
+		result() : ok(false), sections(0), hashed(0), map_new(0), map_existing(0) {}
+	};
+
+	// Result callback, called once per input
+	typedef std::function<void (const result&)> result_fn;
+
+	/**
+	 * @param m hash map to update
+	 * @param o options
+	 */
+	explicit elf_hasher(map& m, const options& o = options());
+	~elf_hasher();
+
+	elf_hasher(const elf_hasher&) = delete;
+	elf_hasher& operator=(const elf_hasher&) = delete;
+
+	/**
+	 * Set the result callback
+	 * @param fn callback, called after each input (also for inputs that failed)
+	 */
+	void on_result(result_fn fn);
+
+	/**
+	 * Hash the strings of a file in place
+	 * Archive members are processed one by one and reported as a single result.
+	 * @param path ELF file, object file or ar archive
+	 * @return false on failure (see result::error)
+	 */
+	bool hash_file(const std::string& path);
+
+	/**
+	 * Hash the strings of an ELF image in memory (in place)
+	 * @param name name of the image (for the map and the messages)
+	 * @param image ELF image (a complete file, not an archive)
+	 * @param size image size
+	 * @return false on failure (see result::error), the image is left unchanged
+	 */
+	bool hash_buffer(const std::string& name, char *image, size_t size);
+
+	// Hash map in use
+	map& get_map();
+
+private:
+	struct impl;
+	impl *_impl;
+};
+
+} // namespace sshash
+
+#endif // SSHASH_HASHER_HPP
@@ -31,6 +31,8 @@
 #ifndef SSHASH_MACROS_HPP
 #define SSHASH_MACROS_HPP
 
+#include <stdint.h>
+
 // Preprocessor tricks for creating unique identifiers
 #define __sshash_pp_cat(x,y) x##y
 #define sshash_pp_cat(x,y) __sshash_pp_cat(x,y)
@@ -38,6 +40,8 @@
 #define sshash_pp_str(x) __sshash_pp_str(x)
 
 // Macro for ELF section placement attribute.
+// Only used for the layouts that place the literals with C arrays
+// (clang, and SSHASH_LEGACY_PAD with GCC).
 #if defined(__clang__)
 
 // Simple section placement works with clang
@@ -54,10 +58,209 @@
 #error "sshash unsupported compiler"
 #endif
 
+// Length of the digest that replaces sensitive strings.
+// Must match the --minlen option of sshash-elf.
+#ifndef SSHASH_DIGEST_LEN
+#define SSHASH_DIGEST_LEN 8
+#endif
+
+namespace sshash {
+
+// Room reserved for a sensitive string literal of size N (including the terminating NUL).
+// Strings shorter than the digest are padded with NULs, just enough for the digest
+// and its terminating NUL. Longer strings are not padded at all.
+template <unsigned long N>
+struct str_room {
+	static constexpr unsigned long value = N > SSHASH_DIGEST_LEN ? N : SSHASH_DIGEST_LEN + 1;
+};
+
+// Bytes [i, i + k) of the literal s of size n, in target byte order
+// (NULs past the end, which is the padding up to the room).
+constexpr uint32_t str_byte(const char *s, unsigned long n, unsigned long i)
+{
+	return i < n ? (unsigned char) s[i] : 0;
+}
+
+constexpr uint32_t str_bytes(const char *s, unsigned long n, unsigned long i, unsigned k)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	return k ? str_byte(s, n, i) << (8 * (k - 1)) | str_bytes(s, n, i + 1, k - 1) : 0;
+#else
+	return k ? str_byte(s, n, i) | str_bytes(s, n, i + 1, k - 1) << 8 : 0;
+#endif
+}
+
+} // namespace sshash
+
+// String descriptors.
+// Each literal also gets a descriptor in the non-allocated .sshash.meta section:
+//   address of the string (pointer size), string length (32 bits), room (32 bits)
+// sshash-elf uses the descriptors to locate and validate the strings directly.
+// Binaries without descriptors are handled by parsing the padding.
+#if __SIZEOF_POINTER__ == 8
+#define __sshash_meta_addr ".quad"
+#else
+#define __sshash_meta_addr ".long"
+#endif
+
+#define __sshash_str_meta(sym, len, room) \
+	__asm__ __volatile__( \
+		".pushsection .sshash.meta,\"\",%%progbits\n" \
+		".balign 4\n" \
+		__sshash_meta_addr " %c0\n" \
+		".long %c1, %c2\n" \
+		".popsection\n" \
+		:: "i"(sym), "i"(len), "i"(room))
+
+// Inline assembly placement.
+// The literal is emitted by inline assembly into the section given by the
+// .pushsection directive 'sect' (which may refer to the room as %c0), under the
+// name the compiler picked for the extern declaration (%c1), followed by its descriptor.
+//
+// The bytes of the literal (and the padding) are computed by the compiler and
+// handed over as immediate operands, in 64 byte chunks of .long words (x86-64 only
+// takes 32-bit immediates), so the assembler never parses the text of the literal.
+// The .ifndef guards make duplicated asm statements (inlining, cloning, unrolling) harmless.
+namespace sshash {
+
+struct str_plain {};
+struct str_merge {};
+
+#define __sshash_str_chunk(sect) \
+	__asm__ __volatile__( \
+		".ifndef .L__sshash_str_%c1_%c2\n" \
+		".set .L__sshash_str_%c1_%c2, 1\n" \
+		sect \
+		".if %c3 >= 4\n.long %c4\n.endif\n" \
+		".if %c3 >= 8\n.long %c5\n.endif\n" \
+		".if %c3 >= 12\n.long %c6\n.endif\n" \
+		".if %c3 >= 16\n.long %c7\n.endif\n" \
+		".if %c3 >= 20\n.long %c8\n.endif\n" \
+		".if %c3 >= 24\n.long %c9\n.endif\n" \
+		".if %c3 >= 28\n.long %c10\n.endif\n" \
+		".if %c3 >= 32\n.long %c11\n.endif\n" \
+		".if %c3 >= 36\n.long %c12\n.endif\n" \
+		".if %c3 >= 40\n.long %c13\n.endif\n" \
+		".if %c3 >= 44\n.long %c14\n.endif\n" \
+		".if %c3 >= 48\n.long %c15\n.endif\n" \
+		".if %c3 >= 52\n.long %c16\n.endif\n" \
+		".if %c3 >= 56\n.long %c17\n.endif\n" \
+		".if %c3 >= 60\n.long %c18\n.endif\n" \
+		".if %c3 >= 64\n.long %c19\n.endif\n" \
+		".if %c3 & 2\n.short %c20\n.endif\n" \
+		".if %c3 & 1\n.byte %c21\n.endif\n" \
+		".popsection\n" \
+		".endif\n" \
+		:: "i"(Room), "i"(Cnt), "i"(Off), "i"(End - Off), \
+		"i"(str_bytes(L::get(), N, Off, 4)), "i"(str_bytes(L::get(), N, Off + 4, 4)), \
+		"i"(str_bytes(L::get(), N, Off + 8, 4)), "i"(str_bytes(L::get(), N, Off + 12, 4)), \
+		"i"(str_bytes(L::get(), N, Off + 16, 4)), "i"(str_bytes(L::get(), N, Off + 20, 4)), \
+		"i"(str_bytes(L::get(), N, Off + 24, 4)), "i"(str_bytes(L::get(), N, Off + 28, 4)), \
+		"i"(str_bytes(L::get(), N, Off + 32, 4)), "i"(str_bytes(L::get(), N, Off + 36, 4)), \
+		"i"(str_bytes(L::get(), N, Off + 40, 4)), "i"(str_bytes(L::get(), N, Off + 44, 4)), \
+		"i"(str_bytes(L::get(), N, Off + 48, 4)), "i"(str_bytes(L::get(), N, Off + 52, 4)), \
+		"i"(str_bytes(L::get(), N, Off + 56, 4)), "i"(str_bytes(L::get(), N, Off + 60, 4)), \
+		"i"(str_bytes(L::get(), N, Tail, 2)), "i"(str_bytes(L::get(), N, Tail + ((End - Off) & 2), 1)))
+
+// Bytes [Off, End) of the literal, split in halves (on chunk boundaries) down to
+// single chunks to keep the template recursion shallow.
+template <typename S, typename L, unsigned long N, unsigned long Room, unsigned long Cnt,
+	unsigned long Off, unsigned long End, bool Split = (End - Off > 64)>
+struct str_data {
+	static constexpr unsigned long Mid = Off + (End - Off + 63) / 128 * 64;
+
+	__attribute__((always_inline)) static inline void emit()
+	{
+		str_data<S, L, N, Room, Cnt, Off, Mid>::emit();
+		str_data<S, L, N, Room, Cnt, Mid, End>::emit();
+	}
+};
+
+template <typename L, unsigned long N, unsigned long Room, unsigned long Cnt, unsigned long Off, unsigned long End>
+struct str_data<str_plain, L, N, Room, Cnt, Off, End, false> {
+	static constexpr unsigned long Tail = Off + (End - Off) / 4 * 4;
+
+	__attribute__((always_inline)) static inline void emit()
+	{
+		__sshash_str_chunk(".pushsection .sshash.str,\"a\",%%progbits\n");
+	}
+};
+
+template <typename L, unsigned long N, unsigned long Room, unsigned long Cnt, unsigned long Off, unsigned long End>
+struct str_data<str_merge, L, N, Room, Cnt, Off, End, false> {
+	static constexpr unsigned long Tail = Off + (End - Off) / 4 * 4;
+
+	__attribute__((always_inline)) static inline void emit()
+	{
+		__sshash_str_chunk(".pushsection .sshash.str.m%c0,\"aM\",%%progbits,%c0\n");
+	}
+};
+
+} // namespace sshash
+
+#define __sshash_str_asm(str, cnt, kind, sect) ({ \
+	struct __sshash_lit { static constexpr const char *get() { return str; } }; \
+	extern const char sshash_pp_cat(__hstr, cnt)[] __attribute__((visibility("hidden"))); \
+	__asm__ __volatile__( \
+		".ifndef %c1\n" \
+		sect \
+		"%c1:\n" \
+		".popsection\n" \
+		".pushsection .sshash.meta,\"\",%%progbits\n" \
+		".balign 4\n" \
+		__sshash_meta_addr " %c1\n" \
+		".long %c2, %c0\n" \
+		".popsection\n" \
+		".endif\n" \
+		:: "i"(::sshash::str_room<sizeof(str)>::value), "i"(sshash_pp_cat(__hstr, cnt)), "i"(sizeof(str) - 1)); \
+	::sshash::str_data<::sshash::kind, __sshash_lit, sizeof(str), ::sshash::str_room<sizeof(str)>::value, cnt, \
+		0, ::sshash::str_room<sizeof(str)>::value>::emit(); \
+	sshash_pp_cat(__hstr, cnt); })
+
+#if defined(SSHASH_MERGE)
+
+// Mergeable layout: each literal is a single entry of a .sshash.str.m<room> section
+// with SHF_MERGE set and entsize equal to the room.
+// The linker folds identical literals across translation units and template
+// instantiations, and the padding is preserved because entries are never split.
+#define __sshash_str(str, cnt) __sshash_str_asm(str, cnt, str_merge, \
+	".pushsection .sshash.str.m%c0,\"aM\",%%progbits,%c0\n")
+
+#elif defined(SSHASH_LEGACY_PAD)
+
+// Legacy layout: strings are always padded by "\0~~~~~~\0" and have no descriptors
 #define __sshash_str(str, cnt) ({ static constexpr char __sshash_str_section() sshash_pp_cat(__hstr, cnt)[] = str"\0~~~~~~"; sshash_pp_cat(__hstr, cnt); })
 
+#elif defined(__clang__)
+
+#define __sshash_str(str, cnt) ({ static constexpr char __sshash_str_section() \
+	sshash_pp_cat(__hstr, cnt)[::sshash::str_room<sizeof(str)>::value] = str; \
+	__sshash_str_meta(sshash_pp_cat(__hstr, cnt), sizeof(str) - 1, ::sshash::str_room<sizeof(str)>::value); \
+	sshash_pp_cat(__hstr, cnt); })
+
+#else
+
+// GCC: all literals of a translation unit go into a single .sshash.str section.
+// The section attribute would need a unique section per invocation (see above),
+// which bloats the objects with section headers, group members and relocation
+// sections, and slows down both the assembler and the linker. It is also ignored
+// for statics of template instantiations, which end up in .rodata in plain text.
+#define __sshash_str(str, cnt) __sshash_str_asm(str, cnt, str_plain, \
+	".pushsection .sshash.str,\"a\",%%progbits\n")
+
+#endif
+
 // String literal for placing into sshash ELF section.
-// The strings are padded by 7 characters to ensure enough room for 8 character SHA digest
+// The strings are padded with NULs to ensure enough room for the SSHASH_DIGEST_LEN character digest.
 #define sshash_str(str) __sshash_str(str, __COUNTER__)
 
+// Start of the sensitive strings (defined by the sshash linker script, see SSHASH_STR_PLACEMENT)
+extern "C" const char __sshash_str_start[] __attribute__((visibility("hidden")));
+
+// Compact 32-bit ID of a sensitive string literal: its offset in the .sshash.str section.
+// Cheaper to log than the string itself (no copy, 4 bytes in raw logs), and stable
+// across hashing. sshash-elf --ids writes the table that maps the IDs of an ELF to the
+// digests, and the sshash format decodes U32 arguments of %s conversions through it.
+#define sshash_id(str) ((uint32_t) (sshash_str(str) - __sshash_str_start))
+
 #endif
@@ -0,0 +1,124 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef SSHASH_MATCHER_HPP
+#define SSHASH_MATCHER_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "sshash/map.hpp"
+#include "sshash/scanner.hpp"
+
+namespace sshash {
+
+// Replaces map strings with their digests (or the other way around) in
+// arbitrary text, in a single linear pass.
+// Matches are selected leftmost-longest: at each position the longest string
+// that starts there wins, and matches never overlap.
+// All methods are const and can be used from several threads at once.
+class matcher {
+public:
+	enum mode {
+		HASH,   // replace strings with digests
+		UNHASH  // replace digests with strings
+	};
+
+	struct match {
+		size_t       start;
+		unsigned int len;
+		unsigned int id;
+	};
+
+	/**
+	 * Build the matcher from the hash map
+	 * @param m hash map ({ digest: { str, elf } })
+	 * @param md replacement direction
+	 * @param minlen ignore patterns shorter than this
+	 */
+	matcher(const map& m, mode md, size_t minlen = 1);
+
+	// Automaton was built (fails if the map is too large)
+	bool valid() const { return _valid; }
+
+	/**
+	 * Find matches that start in [begin, end)
+	 * The scan reads up to max_length() - 1 bytes past end, so that matches
+	 * crossing end are found as well. Matching starts fresh at begin, which lets
+	 * a large buffer be split into ranges that are searched in parallel (see
+	 * sshash-rewrite for the fix-up needed at the seams).
+	 * @param data input buffer
+	 * @param len input buffer length
+	 * @param begin first position a match may start at
+	 * @param end position past the last one a match may start at
+	 * @param out matches are appended here, in order
+	 */
+	void find(const char *data, size_t len, size_t begin, size_t end, std::vector<match>& out) const;
+
+	/**
+	 * Copy [begin, end) replacing the matches
+	 * @param data input buffer
+	 * @param begin first input position
+	 * @param end position past the last input byte
+	 * @param m matches within [begin, end), in order
+	 * @param out output text (appended)
+	 */
+	void apply(const char *data, size_t begin, size_t end, const std::vector<match>& m, std::string& out) const;
+
+	/**
+	 * Replace all matches in a buffer
+	 * @param data input buffer
+	 * @param len input buffer length
+	 * @param out output text (appended)
+	 * @return number of replaced strings
+	 */
+	size_t replace(const char *data, size_t len, std::string& out) const;
+
+	// Replacement for a pattern
+	const std::string& replacement(unsigned int id) const { return _repl[id]; }
+
+	// Number of patterns
+	size_t size() const { return _scanner.size(); }
+
+	// Longest pattern
+	size_t max_length() const { return _scanner.max_length(); }
+
+private:
+	scanner                  _scanner;
+	std::vector<std::string> _repl;
+	bool                     _valid;
+};
+
+} // namespace sshash
+
+#endif // SSHASH_MATCHER_HPP
@@ -0,0 +1,310 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef SSHASH_RESOLVER_HPP
+#define SSHASH_RESOLVER_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sshash/map.hpp"
+
+namespace sshash {
+
+// Digest to string resolver for embedding in log decoding services.
+//
+// Lookups go to an immutable snapshot of the hash map. New maps are published
+// RCU-style: a new snapshot is built off to the side and swapped in atomically.
+// Readers that still hold the old snapshot keep using it until they pick up
+// the new one, and the old one is freed when the last reader drops it.
+// Reloads never block lookups.
+class resolver {
+public:
+	// Immutable digest to string table (open addressing, linear probing)
+	class snapshot {
+	public:
+		/**
+		 * Build a snapshot from the hash map
+		 * @param m hash map ({ digest: { str, elf } })
+		 */
+		explicit snapshot(const map& m);
+
+		/**
+		 * Lookup a digest
+		 * @param hash digest
+		 * @param len digest length
+		 * @return pointer to the original string, or nullptr if the digest is unknown
+		 */
+		const std::string* lookup(const char *hash, size_t len) const
+		{
+			if (!_mask)
+				return nullptr;
+			for (uint32_t i = hash_of(hash, len) & _mask; ; i = (i + 1) & _mask) {
+				uint32_t e = _index[i];
+				if (!e)
+					return nullptr;
+				const entry& x = _entries[e - 1];
+				if (x.digest.size() == len && !memcmp(x.digest.data(), hash, len))
+					return &x.str;
+			}
+		}
+
+		const std::string* lookup(const std::string& hash) const
+		{
+			return lookup(hash.data(), hash.size());
+		}
+
+		/**
+		 * Check that a string looks like a digest: alpha-numeric, starts with
+		 * a letter, and is no shorter or longer than the digests in the table.
+		 */
+		bool is_digest(const char *str, size_t len) const
+		{
+			if (len < _minlen || len > _maxlen || !is_alpha(str[0]))
+				return false;
+			for (size_t i = 1; i < len; i++)
+				if (!is_alnum(str[i]))
+					return false;
+			return true;
+		}
+
+		/**
+		 * Resolve a NUL-terminated string
+		 * Strings that do not look like a digest are rejected without a table lookup.
+		 * @return pointer to the original string, or nullptr if str is not a known digest
+		 */
+		const std::string* resolve(const char *str) const
+		{
+			size_t len = strnlen(str, _maxlen + 1);
+			if (!is_digest(str, len))
+				return nullptr;
+			return lookup(str, len);
+		}
+
+		/**
+		 * Replace digests embedded in text
+		 * Every digest-shaped token (maximal run of alpha-numeric characters)
+		 * that is found in the table is replaced by the original string.
+		 * @param text input text
+		 * @param len input text length
+		 * @param out output text, only filled in if something was replaced
+		 * @return number of replaced digests
+		 */
+		size_t replace(const char *text, size_t len, std::string& out) const;
+
+		size_t size() const { return _entries.size(); }
+
+		// Shortest and longest digest in the table
+		size_t min_length() const { return _minlen; }
+		size_t max_length() const { return _maxlen; }
+
+	private:
+		struct entry {
+			std::string digest;
+			std::string str;
+		};
+
+		static bool is_alpha(char c) { return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z'); }
+		static bool is_alnum(char c) { return is_alpha(c) || (c >= '0' && c <= '9'); }
+
+		// FNV-1a
+		static uint32_t hash_of(const char *s, size_t len)
+		{
+			uint32_t h = 2166136261u;
+			for (size_t i = 0; i < len; i++)
+				h = (h ^ (uint8_t) s[i]) * 16777619u;
+			return h;
+		}
+
+		std::vector<entry>    _entries;
+		std::vector<uint32_t> _index;  // entry index + 1, or 0 for empty slots
+		uint32_t              _mask;
+		size_t                _minlen;
+		size_t                _maxlen;
+	};
+
+	typedef std::shared_ptr<const snapshot> snapshot_ptr;
+
+	// Read-side handle.
+	// Caches a reference to the current snapshot so that a lookup costs a single
+	// atomic load (to detect a newer snapshot) plus the table probe.
+	// A reader must not be shared between threads; create one per thread.
+	class reader {
+	public:
+		explicit reader(const resolver& r) : _r(r), _version(0) { refresh(); }
+
+		/**
+		 * Lookup a digest
+		 * The returned string remains valid until the next call to lookup() or refresh().
+		 * @return pointer to the original string, or nullptr if the digest is unknown
+		 */
+		const std::string* lookup(const char *hash, size_t len)
+		{
+			sync();
+			return _snap ? _snap->lookup(hash, len) : nullptr;
+		}
+
+		const std::string* lookup(const std::string& hash)
+		{
+			return lookup(hash.data(), hash.size());
+		}
+
+		/**
+		 * Resolve a NUL-terminated string (see snapshot::resolve())
+		 * The returned string remains valid until the next call to lookup() or refresh().
+		 */
+		const std::string* resolve(const char *str)
+		{
+			sync();
+			return _snap ? _snap->resolve(str) : nullptr;
+		}
+
+		/**
+		 * Pick up a newer snapshot if one was published
+		 * @return true if the snapshot changed
+		 */
+		bool sync()
+		{
+			if (_r._version.load(std::memory_order_acquire) == _version)
+				return false;
+			refresh();
+			return true;
+		}
+
+		// Pick up the latest snapshot
+		void refresh()
+		{
+			_version = _r._version.load(std::memory_order_acquire);
+			_snap    = _r.get();
+		}
+
+		// Snapshot in use (may be null if nothing was published yet).
+		// Remains valid until the next call to lookup(), resolve(), sync() or refresh().
+		const snapshot* get() const { return _snap.get(); }
+
+		// Version of the snapshot in use
+		uint64_t version() const { return _version; }
+
+	private:
+		const resolver& _r;
+		uint64_t        _version;
+		snapshot_ptr    _snap;
+	};
+
+	resolver() : _snap(), _version(0), _loading(false), _watch_stop(false) {}
+	~resolver() { unwatch(); }
+
+	/**
+	 * Load the hash map from a file and publish it
+	 * The current snapshot stays in use if the file cannot be loaded.
+	 * @param filename name of the JSON file to load
+	 * @return true on success, false on failure
+	 */
+	bool load(const std::string& filename);
+
+	/**
+	 * Publish a new hash map
+	 * @param m hash map
+	 */
+	void publish(const map& m);
+
+	/**
+	 * Publish a prebuilt snapshot
+	 * @param s snapshot (may be null to clear the resolver)
+	 */
+	void publish(snapshot_ptr s);
+
+	/**
+	 * Get the current snapshot
+	 * The snapshot remains valid for as long as the caller holds the pointer.
+	 */
+	snapshot_ptr get() const { return std::atomic_load(&_snap); }
+
+	/**
+	 * Lookup a digest in the current snapshot
+	 * Convenience for occasional lookups, use a reader in hot paths.
+	 * @param hash digest
+	 * @param str output string
+	 * @return true if the digest is known
+	 */
+	bool lookup(const std::string& hash, std::string& str) const;
+
+	/**
+	 * Watch the hash map file and publish it again whenever it changes
+	 * The file (inode, size, mtime) is polled by a background thread, which
+	 * also does the loading, so lookups never wait for a reload.
+	 * A map that fails to load is reported once and the current snapshot is kept.
+	 * If nothing was published yet the map is loaded right away (in the background),
+	 * see wait_ready(). If that fails (e.g. the file does not exist yet) it is retried
+	 * by the polling, like any other update.
+	 * @param filename name of the JSON file to watch
+	 * @param interval_ms polling interval in milliseconds, 0 loads the map (if needed) and stops
+	 */
+	void watch(const std::string& filename, unsigned int interval_ms = 1000);
+
+	// Stop watching the hash map file
+	void unwatch();
+
+	/**
+	 * Wait for the initial map loaded by watch()
+	 * @return true if a snapshot is available, false if the initial load failed
+	 */
+	bool wait_ready();
+
+	// Number of snapshots published so far
+	uint64_t version() const { return _version.load(std::memory_order_acquire); }
+
+private:
+	void watch_loop(std::string filename, unsigned int interval_ms);
+
+	snapshot_ptr          _snap;
+	std::atomic<uint64_t> _version;
+	std::mutex            _publish_mutex;  // serializes publishers
+	std::condition_variable _ready_cond;   // signaled on publish and when the initial load fails
+	bool                  _loading;        // initial load is in progress
+
+	std::thread             _watcher;
+	std::mutex              _watch_mutex;
+	std::condition_variable _watch_cond;
+	bool                    _watch_stop;
+};
+
+} // namespace sshash
+
+#endif // SSHASH_RESOLVER_HPP
@@ -0,0 +1,107 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef SSHASH_SCANNER_HPP
+#define SSHASH_SCANNER_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+namespace sshash {
+
+// Multi-pattern scanner (Aho-Corasick automaton compiled into a DFA).
+// Finds every occurrence of every pattern in a single pass over the input.
+// Input bytes are folded into equivalence classes (bytes that do not appear
+// in any pattern share one class), so the transition table costs
+// 4 * nclasses bytes per trie node.
+class scanner {
+public:
+	scanner();
+
+	// Add a pattern. Must be called before compile().
+	// @param p pattern string (empty patterns are ignored)
+	// @return pattern id
+	unsigned int add(const std::string& p);
+
+	// Build the automaton. No patterns can be added after this.
+	// @return false if the automaton is too large
+	bool compile();
+
+	// Scan a buffer and invoke f(id, end) for every match,
+	// where end is the offset just past the last byte of the match.
+	template <typename F>
+	void scan(const uint8_t *data, size_t len, F f) const
+	{
+		uint32_t s = 0;
+		for (size_t i = 0; i < len; i++) {
+			s = _delta[(s & ~MATCH) + _class[data[i]]];
+			if (s & MATCH)
+				report(s & ~MATCH, i + 1, f);
+		}
+	}
+
+	// Pattern by id
+	const std::string& pattern(unsigned int id) const { return _patterns[id]; }
+
+	size_t size() const { return _patterns.size(); }
+	size_t max_length() const { return _maxlen; }
+	size_t states() const { return _nstates; }
+
+private:
+	template <typename F>
+	void report(uint32_t s, size_t end, F& f) const
+	{
+		for (uint32_t n = s / _nclasses; n; n = _dict[n])
+			if (_out[n] >= 0)
+				f((unsigned int) _out[n], end);
+	}
+
+	// Transitions are stored as row offsets (state * nclasses) so that the
+	// scan loop needs no multiplication. The top bit marks states that
+	// have at least one match on their dictionary suffix chain.
+	static const uint32_t MATCH = 0x80000000;
+
+	std::vector<std::string> _patterns;
+	size_t   _maxlen;
+	uint32_t _nstates;
+	uint32_t _nclasses;
+	uint16_t _class[256];
+
+	std::vector<uint32_t> _delta;
+	std::vector<int32_t>  _out;   // pattern id ending at this state (or -1)
+	std::vector<uint32_t> _dict;  // next state with output on the suffix chain (or 0)
+};
+
+} // namespace sshash
+
+#endif // SSHASH_SCANNER_HPP
@@ -0,0 +1,126 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#include <algorithm>
+
+#include "sshash/matcher.hpp"
+
+namespace sshash {
+
+matcher::matcher(const map& m, mode md, size_t minlen)
+{
+	for (auto &e : m) {
+		std::string str = e.second.get<std::string>("str", std::string());
+		const std::string &from = md == HASH ? str : e.first;
+		const std::string &to   = md == HASH ? e.first : str;
+		if (from.empty() || from.size() < minlen)
+			continue;
+		_scanner.add(from);
+		_repl.push_back(to);
+	}
+	_valid = _scanner.compile();
+}
+
+void matcher::find(const char *data, size_t len, size_t begin, size_t end, std::vector<match>& out) const
+{
+	const size_t maxlen = _scanner.max_length();
+	if (end > len)
+		end = len;
+	if (!_valid || !maxlen || begin >= end)
+		return;
+
+	// Longest match for each start position that is still pending.
+	// A start is final once the scan is maxlen bytes past it, so pending starts
+	// always lie within maxlen of each other and a ring of more than maxlen
+	// entries (indexed by start position) never wraps onto a live entry.
+	size_t rsize = 1;
+	while (rsize <= maxlen)
+		rsize <<= 1;
+	const size_t rmask = rsize - 1;
+	std::vector<match> ring(rsize, match{0, 0, 0});
+
+	size_t pos    = begin; // next start position to finalize
+	size_t cursor = begin; // end of the last selected match
+
+	// Select the final matches that start before limit, left to right
+	auto finalize = [&](size_t limit) {
+		if (limit <= pos)
+			return;
+		size_t n = std::min(limit - pos, rsize);
+		for (size_t s = pos; s < pos + n; s++) {
+			match &r = ring[s & rmask];
+			if (!r.len)
+				continue;
+			if (s >= cursor) {
+				out.push_back(r);
+				cursor = s + r.len;
+			}
+			r.len = 0;
+		}
+		pos = limit;
+	};
+
+	const size_t stop = std::min(len, end + maxlen - 1);
+	_scanner.scan((const uint8_t *) data + begin, stop - begin, [&](unsigned int id, size_t e) {
+		e += begin;
+		size_t l = _scanner.pattern(id).size();
+		size_t s = e - l;
+		if (e >= maxlen)
+			finalize(e - maxlen);
+		if (s >= end)
+			return;
+		match &r = ring[s & rmask];
+		if (r.len < l)
+			r = match{s, (unsigned int) l, id};
+	});
+	finalize(end);
+}
+
+void matcher::apply(const char *data, size_t begin, size_t end, const std::vector<match>& m, std::string& out) const
+{
+	size_t p = begin;
+	for (auto &x : m) {
+		out.append(data + p, x.start - p);
+		out.append(_repl[x.id]);
+		p = x.start + x.len;
+	}
+	if (p < end)
+		out.append(data + p, end - p);
+}
+
+size_t matcher::replace(const char *data, size_t len, std::string& out) const
+{
+	std::vector<match> m;
+	find(data, len, 0, len, m);
+	apply(data, 0, len, m, out);
+	return m.size();
+}
+
+} // namespace sshash
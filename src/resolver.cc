@@ -0,0 +1,330 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <iostream>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "sshash/resolver.hpp"
+
+namespace sshash {
+
+static inline bool is_alnum(uint8_t c)
+{
+	return (uint8_t) (c - '0') < 10 || (uint8_t) ((c | 0x20) - 'a') < 26;
+}
+
+// Bitmask of alpha-numeric characters in a block of up to 64 bytes
+// (bit i is set if p[i] is alpha-numeric)
+static inline uint64_t alnum_mask(const char *p, size_t n)
+{
+	uint64_t m = 0;
+#if defined(__SSE2__)
+	// Short blocks are padded with NULs, which are not alpha-numeric
+	char tail[64];
+	if (n < 64) {
+		memset(tail, 0, sizeof(tail));
+		memcpy(tail, p, n);
+		p = tail;
+	}
+
+	{
+		const __m128i num_lo  = _mm_set1_epi8('0');
+		const __m128i num_rng = _mm_set1_epi8(9);
+		const __m128i alp_lo  = _mm_set1_epi8('a');
+		const __m128i alp_rng = _mm_set1_epi8(25);
+		const __m128i lower   = _mm_set1_epi8(0x20);
+		const __m128i zero    = _mm_setzero_si128();
+
+		for (unsigned int i = 0; i < 4; i++) {
+			__m128i v = _mm_loadu_si128((const __m128i *) (p + i * 16));
+			// x in [lo, lo + rng] <=> saturated (x - lo) - rng == 0
+			__m128i d = _mm_cmpeq_epi8(_mm_subs_epu8(_mm_sub_epi8(v, num_lo), num_rng), zero);
+			__m128i a = _mm_cmpeq_epi8(_mm_subs_epu8(_mm_sub_epi8(_mm_or_si128(v, lower), alp_lo), alp_rng), zero);
+			m |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_or_si128(d, a)) << (i * 16);
+		}
+	}
+#else
+	for (size_t i = 0; i < n; i++)
+		m |= (uint64_t) is_alnum(p[i]) << i;
+#endif
+	return m;
+}
+
+// Split text into tokens (maximal runs of alpha-numeric characters) and
+// invoke f(offset, length) for each token, in order.
+// Token boundaries are extracted from the class bitmasks 64 bytes at a time.
+template <typename F>
+static void tokenize(const char *text, size_t len, F f)
+{
+	uint64_t carry = 0; // last byte of the previous block is alpha-numeric
+	size_t   start = 0;
+
+	for (size_t b = 0; b < len; b += 64) {
+		size_t   n = len - b < 64 ? len - b : 64;
+		uint64_t m = alnum_mask(text + b, n);
+		uint64_t prev = (m << 1) | carry;
+
+		uint64_t starts = m & ~prev;
+		uint64_t ends   = ~m & prev;
+		if (n < 64)
+			ends &= ~0ULL >> (64 - n);
+		carry = m >> 63;
+
+		for (uint64_t ev = starts | ends; ev; ev &= ev - 1) {
+			unsigned int i = __builtin_ctzll(ev);
+			if (starts & (1ULL << i))
+				start = b + i;
+			else
+				f(start, b + i - start);
+		}
+
+		if (n < 64)
+			carry = (m >> (n - 1)) & 1;
+	}
+
+	if (carry)
+		f(start, len - start);
+}
+
+resolver::snapshot::snapshot(const map& m) :
+	_mask(0), _minlen(1), _maxlen(0)
+{
+	_entries.reserve(m.size());
+	for (const auto& kv : m) {
+		entry e;
+		e.digest = kv.first;
+		e.str    = kv.second.get<std::string>("str", std::string());
+		if (e.digest.empty())
+			continue;
+		if (_entries.empty() || e.digest.size() < _minlen)
+			_minlen = e.digest.size();
+		if (e.digest.size() > _maxlen)
+			_maxlen = e.digest.size();
+		_entries.push_back(std::move(e));
+	}
+
+	if (_entries.empty())
+		return;
+
+	// Keep the load factor under 1/2
+	size_t n = 2;
+	while (n < _entries.size() * 2)
+		n <<= 1;
+	_index.assign(n, 0);
+	_mask = n - 1;
+
+	for (size_t e = 0; e < _entries.size(); e++) {
+		const std::string& d = _entries[e].digest;
+		uint32_t i = hash_of(d.data(), d.size()) & _mask;
+		while (_index[i])
+			i = (i + 1) & _mask;
+		_index[i] = e + 1;
+	}
+}
+
+size_t resolver::snapshot::replace(const char *text, size_t len, std::string& out) const
+{
+	size_t done = 0; // end of the text already copied to the output
+	size_t n = 0;
+
+	if (!_mask)
+		return 0;
+
+	tokenize(text, len, [&](size_t off, size_t tlen) {
+		if (!is_digest(text + off, tlen))
+			return;
+		const std::string *s = lookup(text + off, tlen);
+		if (!s)
+			return;
+
+		if (!n)
+			out.clear();
+		out.append(text + done, off - done);
+		out.append(*s);
+		done = off + tlen;
+		n++;
+	});
+
+	if (n)
+		out.append(text + done, len - done);
+	return n;
+}
+
+void resolver::publish(snapshot_ptr s)
+{
+	std::lock_guard<std::mutex> lock(_publish_mutex);
+	std::atomic_store(&_snap, s);
+	_version.fetch_add(1, std::memory_order_release);
+	_ready_cond.notify_all();
+}
+
+void resolver::publish(const map& m)
+{
+	publish(std::make_shared<const snapshot>(m));
+}
+
+bool resolver::load(const std::string& filename)
+{
+	map m;
+	if (!m.load(filename))
+		return false;
+	publish(m);
+	return true;
+}
+
+// File identity and modification state, used for detecting map updates
+struct file_sig {
+	dev_t    dev;
+	ino_t    ino;
+	off_t    size;
+	time_t   mtime;
+	long     mtime_ns;
+
+	bool operator==(const file_sig& o) const
+	{
+		return dev == o.dev && ino == o.ino && size == o.size &&
+			mtime == o.mtime && mtime_ns == o.mtime_ns;
+	}
+	bool operator!=(const file_sig& o) const { return !(*this == o); }
+};
+
+static bool get_file_sig(const std::string& filename, file_sig& sig)
+{
+	struct stat st;
+	if (stat(filename.c_str(), &st) < 0)
+		return false;
+	sig.dev      = st.st_dev;
+	sig.ino      = st.st_ino;
+	sig.size     = st.st_size;
+	sig.mtime    = st.st_mtim.tv_sec;
+	sig.mtime_ns = st.st_mtim.tv_nsec;
+	return true;
+}
+
+void resolver::watch_loop(std::string filename, unsigned int interval_ms)
+{
+	file_sig loaded = {}, failed = {}, sig = {};
+
+	if (_loading) {
+		// Initial load. If it fails wait_ready() reports that, and the map is
+		// retried by the polling below once the file shows up or changes.
+		get_file_sig(filename, sig);
+		map m;
+		bool ok = m.load(filename);
+		if (ok) {
+			publish(m);
+			loaded = sig;
+		} else
+			failed = sig;
+
+		std::lock_guard<std::mutex> lock(_publish_mutex);
+		_loading = false;
+		_ready_cond.notify_all();
+	} else
+		get_file_sig(filename, loaded);
+
+	if (!interval_ms)
+		return;
+
+	std::unique_lock<std::mutex> lock(_watch_mutex);
+	while (!_watch_cond.wait_for(lock, std::chrono::milliseconds(interval_ms), [this] { return _watch_stop; })) {
+		if (!get_file_sig(filename, sig) || sig == loaded || sig == failed)
+			continue;
+
+		lock.unlock();
+		map m;
+		bool ok = m.load(filename);
+		if (ok)
+			publish(m);
+		lock.lock();
+
+		if (ok)
+			loaded = sig;
+		else {
+			// A partially written map fails to parse. It will be retried once it changes again.
+			std::cerr << "sshash: failed to reload " << filename << ", keeping the current map\n";
+			failed = sig;
+		}
+	}
+}
+
+void resolver::watch(const std::string& filename, unsigned int interval_ms)
+{
+	unwatch();
+	_watch_stop = false;
+	{
+		std::lock_guard<std::mutex> lock(_publish_mutex);
+		_loading = !version();
+	}
+	_watcher = std::thread(&resolver::watch_loop, this, filename, interval_ms);
+}
+
+bool resolver::wait_ready()
+{
+	std::unique_lock<std::mutex> lock(_publish_mutex);
+	_ready_cond.wait(lock, [this] { return !_loading || version(); });
+	return version() != 0;
+}
+
+void resolver::unwatch()
+{
+	if (!_watcher.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(_watch_mutex);
+		_watch_stop = true;
+	}
+	_watch_cond.notify_all();
+	_watcher.join();
+}
+
+bool resolver::lookup(const std::string& hash, std::string& str) const
+{
+	snapshot_ptr s = get();
+	if (!s)
+		return false;
+	const std::string* p = s->lookup(hash);
+	if (!p)
+		return false;
+	str = *p;
+	return true;
+}
+
+} // namespace sshash
@@ -0,0 +1,131 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#include <string.h>
+
+#include <deque>
+
+#include "sshash/scanner.hpp"
+
+namespace sshash {
+
+scanner::scanner() : _maxlen(0), _nstates(0), _nclasses(0)
+{
+	memset(_class, 0, sizeof(_class));
+}
+
+unsigned int scanner::add(const std::string& p)
+{
+	_patterns.push_back(p);
+	if (p.size() > _maxlen)
+		_maxlen = p.size();
+	return _patterns.size() - 1;
+}
+
+bool scanner::compile()
+{
+	// Fold input bytes into classes.
+	// Class 0 is shared by all bytes that do not appear in any pattern.
+	bool used[256] = {};
+	for (auto &p : _patterns)
+		for (unsigned char c : p)
+			used[c] = true;
+
+	_nclasses = 1;
+	for (unsigned int c = 0; c < 256; c++)
+		_class[c] = used[c] ? _nclasses++ : 0;
+
+	// Build the trie. Child links are row offsets, zero means no child
+	// (the root is never a child).
+	_nstates = 1;
+	_delta.assign(_nclasses, 0);
+	_out.assign(1, -1);
+
+	for (unsigned int id = 0; id < _patterns.size(); id++) {
+		const std::string& p = _patterns[id];
+		if (p.empty())
+			continue;
+
+		uint32_t row = 0;
+		for (unsigned char c : p) {
+			uint32_t &next = _delta[row + _class[c]];
+			if (!next) {
+				if ((uint64_t) (_nstates + 1) * _nclasses >= MATCH)
+					return false;
+				next = _nstates++ * _nclasses;
+				_delta.resize(_nstates * _nclasses, 0);
+				_out.push_back(-1);
+			}
+			// _delta may have been reallocated
+			row = _delta[row + _class[c]];
+		}
+
+		uint32_t n = row / _nclasses;
+		if (_out[n] < 0)
+			_out[n] = id;
+	}
+
+	// Compute failure and dictionary suffix links in BFS order and turn
+	// the trie into a complete DFA.
+	_dict.assign(_nstates, 0);
+	std::vector<uint32_t> fail(_nstates, 0);
+
+	std::deque<uint32_t> q;
+	q.push_back(0);
+	while (!q.empty()) {
+		uint32_t r = q.front(); q.pop_front();
+		uint32_t rrow = r * _nclasses;
+		uint32_t frow = fail[r] * _nclasses;
+
+		for (uint32_t c = 0; c < _nclasses; c++) {
+			uint32_t &next = _delta[rrow + c];
+			if (!next) {
+				// Missing transitions follow the failure link.
+				// Root's transitions loop back to root.
+				next = r ? _delta[frow + c] : 0;
+				continue;
+			}
+
+			uint32_t v = next / _nclasses;
+			uint32_t f = r ? (_delta[frow + c] & ~MATCH) / _nclasses : 0;
+			fail[v]  = f;
+			_dict[v] = _out[f] >= 0 ? f : _dict[f];
+
+			if (_out[v] >= 0 || _dict[v])
+				next |= MATCH;
+
+			q.push_back(v);
+		}
+	}
+
+	return true;
+}
+
+} // namespace sshash
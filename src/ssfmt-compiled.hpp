@@ -0,0 +1,355 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef SSHASH_SSFMT_COMPILED_HPP
+#define SSHASH_SSFMT_COMPILED_HPP
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+namespace sshash {
+
+// Printf-style format string compiled into a list of segments
+// (literal text and conversions), so that formatting a record is a straight
+// walk over the segments instead of re-parsing the format every time.
+// Only the common conversions are supported (d i u o x X c s p with flags,
+// width, precision and any length modifier). Formats that use anything else
+// ('*' width, floating point, positional args, ...) fail to compile and are
+// left to the generic formatter.
+class compiled_format {
+public:
+	// Argument classes
+	enum arg_class {
+		ARG_NONE,
+		ARG_STR,
+		ARG_S32,
+		ARG_U32,
+		ARG_S64,
+		ARG_U64
+	};
+
+	// Argument value
+	struct arg {
+		unsigned int cls;
+		union {
+			const char *str;
+			uint64_t    val;
+		};
+	};
+
+	compiled_format() : _valid(false), _nargs(0) {}
+
+	/**
+	 * Compile format string
+	 * @param fmt format string
+	 * @return false if the format uses unsupported features
+	 */
+	bool compile(const char *fmt)
+	{
+		_text = fmt;
+		_segs.clear();
+		_convs.clear();
+		_nargs = 0;
+		_valid = false;
+
+		const char *s = _text.c_str();
+		const char *lit = s;
+		while (*s) {
+			if (*s != '%') {
+				s++;
+				continue;
+			}
+			if (s[1] == '%') {
+				// Literal '%': emit the text including the first '%', skip the second
+				add_text(lit, s + 1);
+				s += 2;
+				lit = s;
+				continue;
+			}
+			add_text(lit, s);
+
+			segment c;
+			c.kind  = CONV;
+			c.fast  = true;
+			c.zero  = false;
+			c.width = 0;
+			std::string spec("%");
+			s++;
+
+			// Flags, width and precision.
+			// Conversions with just the '0' flag and/or width are still handled
+			// by the fast path, everything else goes through snprintf.
+			for (; *s && strchr("-+ #0", *s); s++) {
+				spec += *s;
+				if (*s == '0')
+					c.zero = true;
+				else
+					c.fast = false;
+			}
+			for (; *s >= '0' && *s <= '9'; s++) {
+				spec += *s;
+				c.width = c.width * 10 + (*s - '0');
+				if (c.width > 64)
+					c.fast = false;
+			}
+			if (*s == '.') {
+				spec += *s++;
+				for (; *s >= '0' && *s <= '9'; s++)
+					spec += *s;
+				c.fast = false;
+			}
+
+			// Length modifiers are normalized, values are always passed as 64-bit.
+			// Except for 'h' and 'hh' which truncate the value (like printf does).
+			c.bits = 0;
+			if (s[0] == 'h')
+				c.bits = s[1] == 'h' ? 8 : 16;
+			for (; *s && strchr("hlLqjzt", *s); s++)
+				;
+
+			c.conv = *s;
+			if (!c.conv || !strchr("diuoxXcsp", c.conv))
+				return false;
+			s++;
+
+			if (strchr("diuoxX", c.conv))
+				spec += "ll";
+			spec += c.conv;
+			if (spec.size() >= sizeof(c.spec))
+				return false;
+			memcpy(c.spec, spec.c_str(), spec.size() + 1);
+
+			c.off = 0;
+			c.len = 0;
+			_segs.push_back(c);
+			_convs.push_back(c.conv);
+			_nargs++;
+			lit = s;
+		}
+		add_text(lit, s);
+
+		_valid = true;
+		return true;
+	}
+
+	bool valid() const { return _valid; }
+
+	// Number of arguments consumed by the format
+	unsigned int nargs() const { return _nargs; }
+
+	// Conversion character of argument n (0 if the format has fewer arguments)
+	char conv(unsigned int n) const { return n < _nargs ? _convs[n] : 0; }
+
+	/**
+	 * Format the arguments
+	 * @param out output string (appended to)
+	 * @param args argument values
+	 * @param n number of arguments
+	 * @return false if the arguments do not match the format
+	 */
+	bool render(std::string& out, const arg *args, unsigned int n) const
+	{
+		if (n < _nargs)
+			return false;
+
+		unsigned int a = 0;
+		for (const segment &g : _segs) {
+			if (g.kind == TEXT) {
+				out.append(_text, g.off, g.len);
+				continue;
+			}
+			if (!render_conv(out, g, args[a++]))
+				return false;
+		}
+		return true;
+	}
+
+private:
+	enum { TEXT, CONV };
+
+	struct segment {
+		unsigned int kind;
+		uint32_t     off;   // text offset (TEXT)
+		uint32_t     len;   // text length (TEXT)
+		char         conv;  // conversion character (CONV)
+		bool         fast;  // no flags other than '0', no precision
+		bool         zero;  // '0' flag
+		unsigned int width; // field width
+		unsigned int bits;  // value width for 'h' and 'hh' modifiers (or 0)
+		char         spec[24]; // normalized conversion spec for snprintf
+	};
+
+	void add_text(const char *b, const char *e)
+	{
+		if (b == e)
+			return;
+		segment t;
+		t.kind = TEXT;
+		t.off  = b - _text.c_str();
+		t.len  = e - b;
+		t.conv = 0;
+		t.fast = true;
+		t.zero = false;
+		t.width = 0;
+		t.bits = 0;
+		t.spec[0] = 0;
+		_segs.push_back(t);
+	}
+
+	// Append digits (p, n) padded to the field width
+	static void append_field(std::string& out, const segment& g, const char *p, size_t n, bool neg)
+	{
+		size_t len = n + neg;
+		size_t pad = g.width > len ? g.width - len : 0;
+		if (!g.zero)
+			out.append(pad, ' ');
+		if (neg)
+			out += '-';
+		if (g.zero)
+			out.append(pad, '0');
+		out.append(p, n);
+	}
+
+	static void append_dec(std::string& out, const segment& g, uint64_t v, bool neg)
+	{
+		char buf[24];
+		char *p = buf + sizeof(buf);
+		uint32_t v32 = v;
+		if (v32 == v) {
+			do {
+				*--p = '0' + v32 % 10;
+				v32 /= 10;
+			} while (v32);
+		} else {
+			do {
+				*--p = '0' + v % 10;
+				v /= 10;
+			} while (v);
+		}
+		append_field(out, g, p, buf + sizeof(buf) - p, neg);
+	}
+
+	static void append_hex(std::string& out, const segment& g, uint64_t v, bool upper)
+	{
+		const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+		char buf[16];
+		char *p = buf + sizeof(buf);
+		do {
+			*--p = digits[v & 0xf];
+			v >>= 4;
+		} while (v);
+		append_field(out, g, p, buf + sizeof(buf) - p, false);
+	}
+
+	static bool render_conv(std::string& out, const segment& g, const arg& v)
+	{
+		char buf[128];
+		int n;
+
+		if (g.conv == 's') {
+			if (v.cls != ARG_STR)
+				return false;
+			if (g.fast && !g.zero) {
+				if (g.width)
+					append_field(out, g, v.str, strlen(v.str), false);
+				else
+					out.append(v.str);
+				return true;
+			}
+			n = snprintf(buf, sizeof(buf), g.spec, v.str);
+			if (n >= (int) sizeof(buf)) {
+				// Long strings with width or precision
+				std::string tmp(n + 1, 0);
+				snprintf(&tmp[0], n + 1, g.spec, v.str);
+				out.append(tmp.c_str(), n);
+				return true;
+			}
+			out.append(buf, n);
+			return true;
+		}
+
+		if (v.cls == ARG_STR || v.cls == ARG_NONE)
+			return false;
+
+		// Signed conversions see the value with its own signedness and width,
+		// unsigned ones see 32-bit values as 32-bit (like printf would).
+		bool is32 = v.cls == ARG_S32 || v.cls == ARG_U32;
+		int64_t  sv = v.cls == ARG_S32 ? (int64_t) (int32_t) v.val : (int64_t) v.val;
+		uint64_t uv = is32 ? (uint32_t) v.val : v.val;
+		if (g.bits == 16) {
+			sv = (int16_t) sv;
+			uv = (uint16_t) uv;
+		} else if (g.bits == 8) {
+			sv = (int8_t) sv;
+			uv = (uint8_t) uv;
+		}
+
+		if (g.conv == 'p') {
+			n = snprintf(buf, sizeof(buf), g.spec, (void *) (uintptr_t) v.val);
+		} else if (g.conv == 'c') {
+			n = snprintf(buf, sizeof(buf), g.spec, (int) v.val);
+		} else if (g.conv == 'd' || g.conv == 'i') {
+			if (g.fast) {
+				append_dec(out, g, sv < 0 ? -(uint64_t) sv : sv, sv < 0);
+				return true;
+			}
+			n = snprintf(buf, sizeof(buf), g.spec, (long long) sv);
+		} else {
+			if (g.fast && g.conv == 'u') {
+				append_dec(out, g, uv, false);
+				return true;
+			}
+			if (g.fast && (g.conv == 'x' || g.conv == 'X')) {
+				append_hex(out, g, uv, g.conv == 'X');
+				return true;
+			}
+			n = snprintf(buf, sizeof(buf), g.spec, (unsigned long long) uv);
+		}
+
+		if (n < 0 || n >= (int) sizeof(buf))
+			return false;
+		out.append(buf, n);
+		return true;
+	}
+
+	std::string          _text;
+	std::vector<segment> _segs;
+	std::vector<char>    _convs;
+	bool                 _valid;
+	unsigned int         _nargs;
+};
+
+} // namespace sshash
+
+#endif // SSHASH_SSFMT_COMPILED_HPP
@@ -29,115 +29,16 @@
 //  SPDX-License-Identifier: BSD-3-Clause
 
 #include <stdlib.h>
+#include <string.h>
+#include <signal.h>
 
 #include "hogl/format-basic.hpp"
 #include "hogl/plugin/format.hpp"
 
-#include "sshash/map.hpp"
+#include "ssformat.hpp"
 
-// Loadable format plugin with sshash support
-namespace sshash {
-
-// Custom format handler
-class ssformat : public hogl::format_basic {
-private:
-	sshash::map _map;
-
-public:
-	ssformat(const std::string& hashmap, const std::string& spec) :
-		hogl::format_basic(spec.c_str())
-	{
-		// Load map
-		if (!_map.load(hashmap)) {
-			fprintf(stderr, "Failed to load hashmap file\n");
-			fflush(stderr);
-			abort();
-		}
-	}
-
-	// Process log record (called from hogl::engine -> hogl::output)
-	virtual void process(hogl::ostrbuf &sb, const hogl::format::data &d);
-
-	const char* unhash(const char *str)
-	{
-		// Lookup the string in hashmap.
-		// Return as is if not found, otherwise return the original string.
-		try {
-			auto& pt = _map.get_child(std::string(str) + ".str");
-			return pt.data().c_str();
-		} catch (std::exception &e) {
-			return str;
-		}
-	}
-
-	const char* get_arg_str(const hogl::record& r, unsigned int type, unsigned int i)
-	{
-		if (type == hogl::arg::CSTR) {
-			unsigned int len;
-			const char *str = (const char*) r.get_arg_data(i, len);
-			if (!len)
-				return "null";
-			return str;
-		}
-
-		uint64_t ptr;
-		if (hogl::arg::is_32bit(type))
-			ptr = r.get_arg_val32(i);
-		else
-			ptr = r.get_arg_val64(i);
-		return (const char *) ptr;
-	}
-};
-
-void ssformat::process(hogl::ostrbuf &sb, const hogl::format::data &d)
-{
-	const hogl::record &r = *d.record;
-
-	record_data rd = {};
-	rd.record    = d.record;
-	rd.ring_name = d.ring_name;
-	rd.next_arg  = 0;
-
-	// Preprocess names
-	const hogl::area *area = r.area;
-	if (area) {
-		rd.area_name = unhash(area->name());
-		rd.sect_name = unhash(area->section_name(r.section));
-	} else {
-		rd.area_name = "INVALID";
-		rd.sect_name = "INVALID";
-	}
-
-	// Preprocess strings
-	for (unsigned int i = 0; i < hogl::record::NARGS; i++) {
-		unsigned int type = r.get_arg_type(i);
-		if (type == hogl::arg::NONE)
-			break;
-		if (type == hogl::arg::CSTR || type == hogl::arg::GSTR)
-			rd.arg_str[i] = unhash(get_arg_str(r, type, i));
-	}
-
-	if (_fields == DEFAULT)
-		format_basic::default_header(sb, rd);
-	else if (_fields == FAST0)
-		format_basic::fast0_header(sb, rd);
-	else if (_fields == FAST1)
-		format_basic::fast1_header(sb, rd);
-	else
-		format_basic::flexi_header(sb, rd);
-
-	unsigned int t0 = r.get_arg_type(0);
-	unsigned int t1 = r.get_arg_type(1);
-
-	if ((t0 == hogl::arg::CSTR || t0 == hogl::arg::GSTR) && t1 != hogl::arg::NONE)
-		format_basic::output_fmt(sb, rd);
-	else if (t0 == hogl::arg::RAW)
-		format_basic::output_raw(sb, rd);
-	else
-		format_basic::output_plain(sb, rd);
-}
-
-} // namespace sshash
+// Loadable format plugin with sshash support.
+// Configured with SSHASH_FMT_* env variables (see README).
 
 // Allocate and initialize format plugin.
 // Returns a pointer to initialized hogl::format instance
@@ -152,8 +53,52 @@ static hogl::format* create(const char *)
 	const char *spec = getenv("SSHASH_FMT_SPEC");
 	if (!spec)
 		spec = "fast1";
+	const char *substr = getenv("SSHASH_FMT_SUBSTR");
+
+	// Hashmap polling interval (msec), 0 disables reloading
+	unsigned int reload_ms = 1000;
+	const char *reload = getenv("SSHASH_FMT_RELOAD");
+	if (reload)
+		reload_ms = atoi(reload);
+
+	// Background map loading: "buffer" or "raw"
+	sshash::ssformat::lazy_mode lazy = sshash::ssformat::LAZY_OFF;
+	const char *lazy_str = getenv("SSHASH_FMT_LAZY");
+	if (lazy_str && !strcmp(lazy_str, "buffer"))
+		lazy = sshash::ssformat::LAZY_BUFFER;
+	else if (lazy_str && !strcmp(lazy_str, "raw"))
+		lazy = sshash::ssformat::LAZY_RAW;
+	else if (lazy_str && strcmp(lazy_str, "off")) {
+		fprintf(stderr, "SSHASH_FMT_LAZY must be one of: off, buffer, raw\n");
+		fflush(stderr);
+		abort();
+	}
+
+	// Decode statistics: file to append JSON stats to ("-" for stderr).
+	// Stats are dumped on release and on SIGUSR1.
+	const char *stats = getenv("SSHASH_FMT_STATS");
+	if (stats && *stats) {
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = sshash::stats_signal_handler;
+		sa.sa_flags   = SA_RESTART;
+		sigaction(SIGUSR1, &sa, NULL);
+	}
+
+	auto *fmt = new sshash::ssformat(hashmap, spec, substr && atoi(substr), reload_ms, lazy, stats ? stats : "");
+
+	// String ID table (sshash-elf --ids)
+	const char *ids = getenv("SSHASH_FMT_IDS");
+	if (ids && *ids) {
+		std::shared_ptr<sshash::id_table> t(new sshash::id_table);
+		if (!sshash::load_ids(ids, *t)) {
+			fflush(stderr);
+			abort();
+		}
+		fmt->set_ids(t);
+	}
 
-	return new sshash::ssformat(hashmap, spec);
+	return fmt;
 }
 
 // Release all memmory allocated by format plugin.
@@ -0,0 +1,248 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+#include "ssformat.hpp"
+
+namespace sshash {
+
+volatile sig_atomic_t stats_signal;
+
+void stats_signal_handler(int)
+{
+	stats_signal = stats_signal + 1;
+}
+
+bool load_ids(const std::string& filename, id_table& ids)
+{
+	boost::property_tree::ptree pt;
+	try {
+		boost::property_tree::json_parser::read_json(filename, pt);
+	} catch (std::exception &e) {
+		fprintf(stderr, "Failed to load string IDs: %s\n", e.what());
+		return false;
+	}
+
+	for (auto &e : pt) {
+		char *end;
+		unsigned long id = strtoul(e.first.c_str(), &end, 10);
+		if (*end || id > UINT32_MAX) {
+			fprintf(stderr, "Invalid string ID in %s: %s\n", filename.c_str(), e.first.c_str());
+			return false;
+		}
+		ids[id] = e.second.data();
+	}
+	return true;
+}
+
+void ssformat::process(hogl::ostrbuf &sb, const hogl::format::data &d)
+{
+	if (!_timing) {
+		process_record(sb, d);
+		return;
+	}
+
+	uint64_t t0 = now_ns();
+	process_record(sb, d);
+	_stats.add_latency(now_ns() - t0);
+
+	if (_stats_signal != stats_signal) {
+		_stats_signal = stats_signal;
+		dump_stats();
+	}
+}
+
+void ssformat::process_record(hogl::ostrbuf &sb, const hogl::format::data &d)
+{
+	_stats.records++;
+
+	if (!_snap && _lazy == LAZY_BUFFER)
+		wait_map();
+
+	if (!_substr) {
+		format(sb, d);
+		return;
+	}
+
+	_tmp.str.clear();
+	format(_tmp, d);
+	_tmp.flush();
+
+	const std::string &text = _tmp.str;
+	size_t n = _snap ? _snap->replace(text.data(), text.size(), _out) : 0;
+	if (n) {
+		_stats.replaced += n;
+		sb.put((const uint8_t *) _out.data(), _out.size());
+	} else
+		sb.put((const uint8_t *) text.data(), text.size());
+}
+
+void ssformat::format(hogl::ostrbuf &sb, const hogl::format::data &d)
+{
+	const hogl::record &r = *d.record;
+
+	record_data rd = {};
+	rd.record    = d.record;
+	rd.ring_name = d.ring_name;
+	rd.next_arg  = 0;
+
+	// Stick to one snapshot for the whole record
+	if (_reader.sync()) {
+		_snap = _reader.get();
+		reset_caches();
+		_stats.map_updates++;
+	}
+
+	// Map is still loading, mark the record
+	if (!_snap) {
+		_stats.unresolved++;
+		static const char unresolved[] = "[unresolved] ";
+		sb.put((const uint8_t *) unresolved, sizeof(unresolved) - 1);
+	}
+
+	// Preprocess names
+	const hogl::area *area = r.area;
+	if (area) {
+		rd.area_name = unhash_stable(area->name());
+		rd.sect_name = unhash_stable(area->section_name(r.section));
+	} else {
+		rd.area_name = "INVALID";
+		rd.sect_name = "INVALID";
+	}
+
+	// Preprocess strings
+	for (unsigned int i = 0; i < hogl::record::NARGS; i++) {
+		unsigned int type = r.get_arg_type(i);
+		if (type == hogl::arg::NONE)
+			break;
+		if (type == hogl::arg::CSTR)
+			rd.arg_str[i] = unhash(get_arg_str(r, type, i));
+		else if (type == hogl::arg::GSTR)
+			rd.arg_str[i] = unhash_stable(get_arg_str(r, type, i));
+	}
+
+	if (_fields == DEFAULT)
+		format_basic::default_header(sb, rd);
+	else if (_fields == FAST0)
+		format_basic::fast0_header(sb, rd);
+	else if (_fields == FAST1)
+		format_basic::fast1_header(sb, rd);
+	else
+		format_basic::flexi_header(sb, rd);
+
+	unsigned int t0 = r.get_arg_type(0);
+	unsigned int t1 = r.get_arg_type(1);
+
+	if (t0 == hogl::arg::GSTR && t1 != hogl::arg::NONE && output_compiled(sb, rd))
+		_stats.fmt_compiled++;
+	else if ((t0 == hogl::arg::CSTR || t0 == hogl::arg::GSTR) && t1 != hogl::arg::NONE) {
+		_stats.fmt_generic++;
+		format_basic::output_fmt(sb, rd);
+	}
+	else if (t0 == hogl::arg::RAW)
+		format_basic::output_raw(sb, rd);
+	else
+		format_basic::output_plain(sb, rd);
+}
+
+bool ssformat::output_compiled(hogl::ostrbuf &sb, record_data &rd)
+{
+	typedef sshash::compiled_format cf;
+	const hogl::record &r = *rd.record;
+
+	const char *fmt = rd.arg_str[0];
+	auto it = _formats.find(fmt);
+	if (it == _formats.end()) {
+		it = _formats.emplace(fmt, fmt_entry()).first;
+		it->second.ok = it->second.cf.compile(fmt);
+	}
+	if (!it->second.ok)
+		return false;
+
+	const cf &f = it->second.cf;
+	unsigned int n = 0;
+	for (unsigned int i = 1; i < hogl::record::NARGS; i++, n++) {
+		unsigned int type = r.get_arg_type(i);
+		cf::arg &a = _args[n];
+
+		// String ID
+		if (f.conv(n) == 's' && (type == hogl::arg::U32 || type == hogl::arg::S32)) {
+			a.cls = cf::ARG_STR;
+			a.str = resolve_id(r.get_arg_val32(i), i);
+			continue;
+		}
+
+		switch (type) {
+		case hogl::arg::NONE:
+			goto done;
+		case hogl::arg::CSTR:
+		case hogl::arg::GSTR:
+			a.cls = cf::ARG_STR;
+			a.str = rd.arg_str[i];
+			break;
+		case hogl::arg::U32:
+			a.cls = cf::ARG_U32;
+			a.val = r.get_arg_val32(i);
+			break;
+		case hogl::arg::S32:
+			a.cls = cf::ARG_S32;
+			a.val = r.get_arg_val32(i);
+			break;
+		case hogl::arg::U64:
+		case hogl::arg::POINTER:
+			a.cls = cf::ARG_U64;
+			a.val = r.get_arg_val64(i);
+			break;
+		case hogl::arg::S64:
+			a.cls = cf::ARG_S64;
+			a.val = r.get_arg_val64(i);
+			break;
+		default:
+			// Doubles, hexdumps, etc are left to the generic formatter
+			return false;
+		}
+	}
+done:
+	_line.clear();
+	if (!f.render(_line, _args, n))
+		return false;
+	_line += '\n';
+	sb.put((const uint8_t *) _line.data(), _line.size());
+	return true;
+}
+
+} // namespace sshash
@@ -0,0 +1,444 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef SSHASH_SSFORMAT_HPP
+#define SSHASH_SSFORMAT_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "hogl/format-basic.hpp"
+
+#include "sshash/resolver.hpp"
+#include "ssfmt-compiled.hpp"
+
+namespace sshash {
+
+// Output buffer that collects the formatted record into a string
+class ostrbuf_str : public hogl::ostrbuf {
+public:
+	std::string str;
+
+	ostrbuf_str() : hogl::ostrbuf(4096) {}
+
+private:
+	void do_flush(const uint8_t *data, size_t len)
+	{
+		str.append((const char *) data, len);
+	}
+};
+
+// Decode statistics.
+// Owned by a format instance, which is driven by a single output thread,
+// so the counters are plain (per-thread) integers.
+struct decode_stats {
+	uint64_t records;
+	uint64_t unresolved;  // records formatted before the map was loaded
+	uint64_t hits;        // strings resolved
+	uint64_t misses;      // digest-shaped strings that are not in the map
+	uint64_t rejected;    // strings that do not look like a digest
+	uint64_t memo_hits;   // stable strings found in the cache
+	uint64_t memo_misses;
+	uint64_t replaced;    // digests replaced in substring mode
+	uint64_t map_updates; // map snapshots picked up
+	uint64_t fmt_compiled; // records formatted with a precompiled format
+	uint64_t fmt_generic;  // records formatted with the generic formatter
+	uint64_t id_hits;      // string IDs found in the ID table
+	uint64_t id_misses;
+
+	// Per-record formatting latency: bucket n counts latencies in [2^n, 2^(n+1)) nsec
+	enum { NBUCKETS = 32 };
+	uint64_t latency[NBUCKETS];
+	uint64_t latency_count;
+	uint64_t latency_sum;
+	uint64_t latency_max;
+
+	// Add counters from another instance
+	void merge(const decode_stats& s)
+	{
+		records      += s.records;
+		unresolved   += s.unresolved;
+		hits         += s.hits;
+		misses       += s.misses;
+		rejected     += s.rejected;
+		memo_hits    += s.memo_hits;
+		memo_misses  += s.memo_misses;
+		replaced     += s.replaced;
+		map_updates  += s.map_updates;
+		fmt_compiled += s.fmt_compiled;
+		fmt_generic  += s.fmt_generic;
+		id_hits      += s.id_hits;
+		id_misses    += s.id_misses;
+		for (unsigned int b = 0; b < NBUCKETS; b++)
+			latency[b] += s.latency[b];
+		latency_count += s.latency_count;
+		latency_sum   += s.latency_sum;
+		if (s.latency_max > latency_max)
+			latency_max = s.latency_max;
+	}
+
+	void add_latency(uint64_t ns)
+	{
+		unsigned int b = ns ? 63 - __builtin_clzll(ns) : 0;
+		latency[b < NBUCKETS ? b : NBUCKETS - 1]++;
+		latency_count++;
+		latency_sum += ns;
+		if (ns > latency_max)
+			latency_max = ns;
+	}
+
+	// Dump as a single line JSON object
+	void dump(FILE *f) const
+	{
+		uint64_t lookups = hits + misses + rejected;
+		uint64_t memo    = memo_hits + memo_misses;
+
+		fprintf(f, "{\"records\": %llu, \"unresolved_records\": %llu, \"map_updates\": %llu, "
+			"\"strings\": {\"lookups\": %llu, \"hits\": %llu, \"misses\": %llu, \"rejected\": %llu, \"hit_rate\": %.4f}, "
+			"\"cache\": {\"hits\": %llu, \"misses\": %llu, \"hit_rate\": %.4f}, "
+			"\"substr_replaced\": %llu, \"formats\": {\"compiled\": %llu, \"generic\": %llu}, "
+			"\"ids\": {\"hits\": %llu, \"misses\": %llu}",
+			(unsigned long long) records, (unsigned long long) unresolved, (unsigned long long) map_updates,
+			(unsigned long long) lookups, (unsigned long long) hits, (unsigned long long) misses,
+			(unsigned long long) rejected, lookups ? (double) hits / lookups : 0.0,
+			(unsigned long long) memo_hits, (unsigned long long) memo_misses, memo ? (double) memo_hits / memo : 0.0,
+			(unsigned long long) replaced, (unsigned long long) fmt_compiled, (unsigned long long) fmt_generic,
+			(unsigned long long) id_hits, (unsigned long long) id_misses);
+
+		fprintf(f, ", \"latency_ns\": {\"count\": %llu, \"mean\": %.1f, \"max\": %llu, \"histogram\": [",
+			(unsigned long long) latency_count, latency_count ? (double) latency_sum / latency_count : 0.0,
+			(unsigned long long) latency_max);
+		bool first = true;
+		for (unsigned int b = 0; b < NBUCKETS; b++) {
+			if (!latency[b])
+				continue;
+			fprintf(f, "%s{\"ge\": %llu, \"lt\": %llu, \"count\": %llu}", first ? "" : ", ",
+				1ULL << b, 1ULL << (b + 1), (unsigned long long) latency[b]);
+			first = false;
+		}
+		fprintf(f, "]}}\n");
+	}
+};
+
+// Incremented by SIGUSR1, format instances dump their stats on the next record
+extern volatile sig_atomic_t stats_signal;
+
+// SIGUSR1 handler that requests a stats dump
+void stats_signal_handler(int);
+
+// String ID table (see sshash_id()): ID -> digest
+typedef std::unordered_map<uint32_t, std::string> id_table;
+
+/**
+ * Load string ID table
+ * @param filename ID table written by sshash-elf --ids
+ * @param ids table to add the IDs to
+ * @return false on failure
+ */
+bool load_ids(const std::string& filename, id_table& ids);
+
+// Hogl format that unhashes area and section names, format strings and
+// string arguments before formatting the record.
+// Used by the format plugin (hogl-cook) and by sshash-unhash.
+// An instance is driven by a single thread.
+class ssformat : public hogl::format_basic {
+private:
+	std::unique_ptr<sshash::resolver> _own_resolver; // null if the resolver is shared
+	sshash::resolver &_resolver;
+	sshash::resolver::reader _reader;
+	const sshash::resolver::snapshot *_snap; // snapshot used for the current record
+
+	// Cache of unhashed strings with stable addresses (area and section names,
+	// GSTR arguments). Direct mapped, indexed by the string pointer.
+	// Entries point into the snapshot and are dropped when the snapshot changes.
+	struct memo {
+		const char *key;
+		const char *val;
+	};
+	enum { MEMO_SIZE = 1024 };
+	memo _memo[MEMO_SIZE];
+
+	void clear_memo() { memset(_memo, 0, sizeof(_memo)); }
+
+	// Precompiled format strings, indexed by the (unhashed) format string pointer.
+	// GSTR formats have stable addresses, and so do the unhashed strings in the
+	// snapshot. The cache is dropped when the snapshot changes.
+	struct fmt_entry {
+		bool ok; // format is supported
+		sshash::compiled_format cf;
+	};
+	std::unordered_map<const char *, fmt_entry> _formats;
+	std::string _line;
+	sshash::compiled_format::arg _args[hogl::record::NARGS];
+
+	// Format the record with a precompiled format
+	// @return false if the format or the arguments are not supported
+	bool output_compiled(hogl::ostrbuf &sb, record_data &rd);
+
+	// String ID table (see sshash_id()): ID -> digest.
+	// Integer arguments of %s conversions are string IDs, they are resolved to
+	// the digest and then unhashed. Only supported with precompiled formats.
+	// The table is immutable and can be shared by several instances.
+	std::shared_ptr<const id_table> _ids;
+	char _idbuf[hogl::record::NARGS][24]; // unknown IDs
+
+	const char* resolve_id(uint32_t id, unsigned int i)
+	{
+		auto it = _ids ? _ids->find(id) : id_table::const_iterator();
+		if (!_ids || it == _ids->end()) {
+			_stats.id_misses++;
+			snprintf(_idbuf[i], sizeof(_idbuf[i]), "[id:%u]", id);
+			return _idbuf[i];
+		}
+		_stats.id_hits++;
+		return unhash_stable(it->second.c_str());
+	}
+
+	// Substring mode: digests embedded anywhere in the formatted output are
+	// replaced as well (e.g. hashed keys copied into dynamic messages).
+	// Records are formatted into a side buffer and rewritten in a single pass.
+	bool        _substr;
+	ostrbuf_str _tmp;
+	std::string _out;
+
+	unsigned int _lazy;
+
+	// Statistics, dumped into _stats_file (if set)
+	decode_stats _stats;
+	bool         _timing;     // collect latency stats
+	std::string  _stats_file;
+	sig_atomic_t _stats_signal;
+
+	static uint64_t now_ns()
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+	}
+
+	// Format the record, unhash substrings if needed
+	void process_record(hogl::ostrbuf &sb, const hogl::format::data &d);
+
+	// Format the record
+	void format(hogl::ostrbuf &sb, const hogl::format::data &d);
+
+	// Wait for the map that is being loaded in the background
+	void wait_map()
+	{
+		if (!_resolver.wait_ready()) {
+			fprintf(stderr, "Failed to load hashmap file\n");
+			fflush(stderr);
+			abort();
+		}
+	}
+
+public:
+	// Map loading modes
+	enum lazy_mode {
+		LAZY_OFF,    // load the map before returning from create()
+		LAZY_BUFFER, // load in the background, records wait for the map
+		LAZY_RAW     // load in the background, records are emitted unresolved until the map is ready
+	};
+
+	/**
+	 * Create a format with its own resolver
+	 * @param hashmap name of the hash map file
+	 * @param spec hogl format spec
+	 * @param substr replace digests embedded in the formatted output
+	 * @param reload_ms hash map polling interval in msec, 0 disables reloading
+	 * @param lazy map loading mode
+	 * @param stats_file file to append stats to ("-" for stderr, empty to disable)
+	 */
+	ssformat(const std::string& hashmap, const std::string& spec, bool substr, unsigned int reload_ms, lazy_mode lazy,
+			const std::string& stats_file) :
+		hogl::format_basic(spec.c_str()),
+		_own_resolver(new sshash::resolver),
+		_resolver(*_own_resolver),
+		_reader(_resolver),
+		_snap(nullptr),
+		_substr(substr),
+		_lazy(lazy),
+		_timing(!stats_file.empty()),
+		_stats_file(stats_file),
+		_stats_signal(stats_signal)
+	{
+		clear_memo();
+		memset(&_stats, 0, sizeof(_stats));
+
+		if (lazy != LAZY_OFF) {
+			// Initial load is done by the watcher thread
+			_resolver.watch(hashmap, reload_ms);
+			return;
+		}
+
+		// Load map
+		if (!_resolver.load(hashmap)) {
+			fprintf(stderr, "Failed to load hashmap file\n");
+			fflush(stderr);
+			abort();
+		}
+		_reader.refresh();
+		_snap = _reader.get();
+
+		// Pick up new maps in the background, records switch over between records
+		if (reload_ms)
+			_resolver.watch(hashmap, reload_ms);
+	}
+
+	/**
+	 * Create a format that shares a resolver with other instances
+	 * The resolver must outlive the format. Records are formatted unresolved
+	 * until the resolver has a map.
+	 * @param r resolver
+	 * @param spec hogl format spec
+	 * @param substr replace digests embedded in the formatted output
+	 * @param timing collect per-record latency stats
+	 */
+	ssformat(sshash::resolver& r, const std::string& spec, bool substr, bool timing = false) :
+		hogl::format_basic(spec.c_str()),
+		_resolver(r),
+		_reader(_resolver),
+		_snap(_reader.get()),
+		_substr(substr),
+		_lazy(LAZY_RAW),
+		_timing(timing),
+		_stats_signal(stats_signal)
+	{
+		clear_memo();
+		memset(&_stats, 0, sizeof(_stats));
+	}
+
+	~ssformat()
+	{
+		dump_stats();
+	}
+
+	// Stats collected so far
+	const decode_stats& stats() const { return _stats; }
+
+	// Use string ID table
+	void set_ids(const std::shared_ptr<const id_table>& ids) { _ids = ids; }
+
+	// Drop the caches that are keyed by string addresses (memo and precompiled formats).
+	// Must be called when the strings of the records go away, e.g. when the raw log
+	// parser that owns them is destroyed and another one may reuse the addresses.
+	void reset_caches()
+	{
+		clear_memo();
+		_formats.clear();
+	}
+
+	// Process log record (called from hogl::engine -> hogl::output)
+	virtual void process(hogl::ostrbuf &sb, const hogl::format::data &d);
+
+	// Append stats to the stats file ("-" for stderr)
+	void dump_stats()
+	{
+		if (_stats_file.empty())
+			return;
+		FILE *f = _stats_file == "-" ? stderr : fopen(_stats_file.c_str(), "a");
+		if (!f) {
+			fprintf(stderr, "Failed to open stats file %s: %s\n", _stats_file.c_str(), strerror(errno));
+			return;
+		}
+		_stats.dump(f);
+		if (f != stderr)
+			fclose(f);
+		else
+			fflush(f);
+	}
+
+	const char* unhash(const char *str)
+	{
+		// Lookup the string in hashmap.
+		// Return as is if not found, otherwise return the original string.
+		// Strings that do not look like a digest are rejected without a lookup.
+		if (!_snap || !str)
+			return str;
+
+		size_t len = strnlen(str, _snap->max_length() + 1);
+		if (!_snap->is_digest(str, len)) {
+			_stats.rejected++;
+			return str;
+		}
+
+		const std::string *s = _snap->lookup(str, len);
+		if (!s) {
+			_stats.misses++;
+			return str;
+		}
+		_stats.hits++;
+		return s->c_str();
+	}
+
+	// Unhash a string with a stable address
+	const char* unhash_stable(const char *str)
+	{
+		// Fibonacci hashing of the pointer
+		memo &m = _memo[((uint64_t) (uintptr_t) str * 11400714819323198485ull) >> (64 - 10)];
+		if (m.key != str) {
+			m.key = str;
+			m.val = unhash(str);
+			_stats.memo_misses++;
+		} else
+			_stats.memo_hits++;
+		return m.val;
+	}
+
+	const char* get_arg_str(const hogl::record& r, unsigned int type, unsigned int i)
+	{
+		if (type == hogl::arg::CSTR) {
+			unsigned int len;
+			const char *str = (const char*) r.get_arg_data(i, len);
+			if (!len)
+				return "null";
+			return str;
+		}
+
+		uint64_t ptr;
+		if (hogl::arg::is_32bit(type))
+			ptr = r.get_arg_val32(i);
+		else
+			ptr = r.get_arg_val64(i);
+		return (const char *) ptr;
+	}
+};
+
+} // namespace sshash
+
+#endif // SSHASH_SSFORMAT_HPP
@@ -0,0 +1,99 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <string>
+#include <iostream>
+
+#include "ssfmt-compiled.hpp"
+
+// Compiled formats (ssfmt-compiled.hpp) must render exactly what the generic
+// formatter does, which hands each conversion to snprintf as written.
+
+typedef sshash::compiled_format cf;
+
+static cf::arg make_arg(const char *s)         { cf::arg a; a.cls = cf::ARG_STR; a.str = s; return a; }
+static cf::arg make_arg(int v)                 { cf::arg a; a.cls = cf::ARG_S32; a.val = (uint64_t) (int64_t) v; return a; }
+static cf::arg make_arg(unsigned int v)        { cf::arg a; a.cls = cf::ARG_U32; a.val = v; return a; }
+static cf::arg make_arg(long long v)           { cf::arg a; a.cls = cf::ARG_S64; a.val = (uint64_t) v; return a; }
+static cf::arg make_arg(unsigned long long v)  { cf::arg a; a.cls = cf::ARG_U64; a.val = v; return a; }
+static cf::arg make_arg(const void *p)         { cf::arg a; a.cls = cf::ARG_U64; a.val = (uintptr_t) p; return a; }
+
+static unsigned int failures;
+
+template <typename... Args>
+static void check(const char *fmt, Args... args)
+{
+	char ref[512];
+	snprintf(ref, sizeof(ref), fmt, args...);
+
+	cf f;
+	cf::arg a[] = { make_arg(args)... };
+	std::string out;
+	if (!f.compile(fmt) || !f.render(out, a, sizeof...(args))) {
+		std::cerr << "[" << fmt << "] was not rendered\n";
+		failures++;
+		return;
+	}
+	if (out != ref) {
+		std::cerr << "[" << fmt << "] compiled [" << out << "] expected [" << ref << "]\n";
+		failures++;
+	}
+}
+
+int main()
+{
+	const void *p = (const void *) (uintptr_t) 0x7ffdeadbeef0ull;
+
+	check("plain %s, %d, %u, %x, %X", "str", -42, 42u, 0xbeefu, 0xbeefu);
+	check("%08x|%-5d|%5d|%05d", 0x1234u, 7, -7, -7);
+	check("%hhu %hu %hd", 0x1ffu, 0x1ffffu, 0x18000);
+	check("%lld %llu %llx %#llx", -1234567890123ll, 1234567890123ull, 0xfeedfacecafeull, 0xfeedfacecafeull);
+	check("%10s|%-10s|%.3s|%c", "right", "left", "truncated", 'x');
+	check("%o %#o %+d % d", 8u, 8u, 5, 5);
+	check("%%literal %s%%", "pct");
+
+	// Pointers with flags and width
+	check("%p", p);
+	check("%16p|", p);
+	check("%-18p|", p);
+	check("%20p|%-20p|", p, p);
+	check("[%p]", (const void *) 0);
+	check("[%12p]", (const void *) 0);
+
+	if (failures) {
+		std::cerr << failures << " formats differ\n";
+		return 1;
+	}
+	printf("all formats match\n");
+	return 0;
+}
@@ -0,0 +1,156 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#include "sshash/hasher.hpp"
+
+// Checks the in-process hashing API: hashing an ELF image in memory gives the
+// same bytes and the same map as hashing a copy of the file, and hashing
+// the result again changes nothing.
+// The input files are not modified.
+
+static bool read_file(const std::string& name, std::vector<char>& buf)
+{
+	std::ifstream f(name, std::ios::binary);
+	buf.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+	return f.good() || f.eof();
+}
+
+static bool write_file(const std::string& name, const std::vector<char>& buf)
+{
+	std::ofstream f(name, std::ios::binary | std::ios::trunc);
+	f.write(buf.data(), buf.size());
+	return f.good();
+}
+
+static bool test_file(const std::string& name)
+{
+	std::vector<char> orig;
+	if (!read_file(name, orig) || orig.empty()) {
+		std::cerr << name << ": failed to read\n";
+		return false;
+	}
+
+	// Hash in memory
+	sshash::map mem_map;
+	sshash::elf_hasher mem(mem_map);
+
+	sshash::elf_hasher::result mr;
+	mem.on_result([&](const sshash::elf_hasher::result& r) { mr = r; });
+
+	std::vector<char> image(orig);
+	if (!mem.hash_buffer(name, image.data(), image.size())) {
+		std::cerr << name << ": hash_buffer failed: " << mr.error;
+		return false;
+	}
+
+	// Hash a copy of the file
+	std::string copy = name + ".hasher-copy";
+	if (!write_file(copy, orig)) {
+		std::cerr << copy << ": failed to write\n";
+		return false;
+	}
+
+	sshash::map file_map;
+	sshash::elf_hasher file(file_map);
+
+	sshash::elf_hasher::result fr;
+	file.on_result([&](const sshash::elf_hasher::result& r) { fr = r; });
+
+	bool ok = file.hash_file(copy);
+	std::vector<char> hashed;
+	ok = ok && read_file(copy, hashed);
+	remove(copy.c_str());
+	if (!ok) {
+		std::cerr << copy << ": hash_file failed: " << fr.error;
+		return false;
+	}
+
+	if (image != hashed) {
+		std::cerr << name << ": image hashed in memory differs from the hashed file\n";
+		return false;
+	}
+	if (mem_map.size() != file_map.size() || mr.hashed != fr.hashed || mr.strings.size() != mem_map.size()) {
+		std::cerr << name << ": map or result mismatch: " << mem_map.size() << "/" << file_map.size() << " entries, "
+			<< mr.hashed << "/" << fr.hashed << " hashed\n";
+		return false;
+	}
+	for (auto &e : mem_map) {
+		if (file_map.get<std::string>(e.first + ".str", "") != e.second.get<std::string>("str")) {
+			std::cerr << name << ": digest " << e.first << " differs\n";
+			return false;
+		}
+	}
+	if (mr.hashed && image == orig) {
+		std::cerr << name << ": nothing was replaced\n";
+		return false;
+	}
+
+	// Hashing again is a no-op
+	std::vector<char> again(image);
+	if (!mem.hash_buffer(name, again.data(), again.size()) || again != image || mr.hashed || mr.map_new) {
+		std::cerr << name << ": hashing again changed the image (" << mr.hashed << " hashed) " << mr.error;
+		return false;
+	}
+
+	std::cout << name << ": " << mem_map.size() << " strings, " << fr.sections << " sections\n";
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: hasher-test elf-files\n";
+		return 1;
+	}
+
+	for (int i = 1; i < argc; i++)
+		if (!test_file(argv[i]))
+			return 1;
+
+	// Not an ELF image
+	sshash::map map;
+	sshash::elf_hasher h(map);
+	std::string junk(4096, 'x');
+	if (h.hash_buffer("junk", &junk[0], junk.size())) {
+		std::cerr << "junk image was accepted\n";
+		return 1;
+	}
+
+	std::cout << "hasher test passed\n";
+	return 0;
+}
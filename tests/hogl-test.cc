@@ -47,12 +47,25 @@
 #include <hogl/area.hpp>
 #include <hogl/mask.hpp>
 #include <hogl/post.hpp>
+#include <hogl/tls.hpp>
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <algorithm>
 
 #include "sshash/macros.hpp"
+#include "sshash/map.hpp"
+#include "sshash/resolver.hpp"
+#include "ssformat.hpp"
 
 static const hogl::area *test_area;
+static bool use_ids = false;
 
 #define __ssi(str) hogl::arg_gstr(sshash_str(str))
+#define __ssid(str) sshash_id(str)
 #define dbglogss(area, sect, fmt, args...) hogl::post(area, area->sect, __ssi(fmt), ##args)
 #define dbglog(area, sect, fmt, args...)   hogl::post(area, area->sect, hogl::arg_gstr(fmt), ##args)
 
@@ -62,6 +75,9 @@ void test_temp(T a)
 	dbglog(test_area, DEBUG, __ssi("template function arg: [%s]"), std::to_string(a));
 }
 
+// Number of records posted by each doTest() loop
+static const unsigned int loop_records = 13;
+
 void doTest(unsigned int nloops)
 {
 	for (unsigned int n=0; n < nloops; ++n) {
@@ -71,8 +87,14 @@ void doTest(unsigned int nloops)
 		dbglogss(test_area, INFO, "sensitive info 0-args");
 		dbglogss(test_area, DEBUG, "sensitive debug [%d] [%d]", n*100, n*200);
 		dbglog(test_area, WARN, "plain warn 2-str-args: [%s] [%s]", "abc", "xyz");
-		dbglog(test_area, ERROR, "plain error 2-ssi-args: [%s] [%s]", __ssi("top secret ABC info"), __ssi("top secret EDF info"));
-		dbglogss(test_area, DEBUG, "sensitive debug 2-ssi-arg: [%s]", __ssi("top secret XYZ info"));
+		if (use_ids) {
+			// Sensitive args logged as string IDs
+			dbglog(test_area, ERROR, "plain error 2-ssi-args: [%s] [%s]", __ssid("top secret ABC info"), __ssid("top secret EDF info"));
+			dbglogss(test_area, DEBUG, "sensitive debug 2-ssi-arg: [%s]", __ssid("top secret XYZ info"));
+		} else {
+			dbglog(test_area, ERROR, "plain error 2-ssi-args: [%s] [%s]", __ssi("top secret ABC info"), __ssi("top secret EDF info"));
+			dbglogss(test_area, DEBUG, "sensitive debug 2-ssi-arg: [%s]", __ssi("top secret XYZ info"));
+		}
 		dbglogss(test_area, INFO, "short SSI");
 
 		test_temp(25);
@@ -86,16 +108,228 @@ void doTest(unsigned int nloops)
 	}
 }
 
+// ---- Logging throughput benchmark (--bench)
+//
+// Producer threads post records through their own (blocking) hogl rings, and
+// the engine formats them into the log output (/dev/null by default).
+// Each run is a combination of:
+//   strings:  plain literals, sshash_str() strings, or sshash_str() formats with
+//             string ID args. Run the benchmark before and after sshash-elf to
+//             compare unhashed and hashed binaries.
+//   pipeline: format_basic, format_raw, or decode (the sshash format that the
+//             plugin uses, unhashing the records in-process)
+// Reported per run: records/sec seen by the producers and end-to-end (until
+// everything is written), hogl::post() latency percentiles (including the
+// clock reads), and the decode cost per record.
+
+// Records posted by each bench loop
+static const unsigned int bench_records = 6;
+
+static inline uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Time a single post
+#define timed(lat, stmt) do { uint64_t _t0 = now_ns(); stmt; lat.push_back(now_ns() - _t0); } while (0)
+
+enum bench_strings { BENCH_PLAIN, BENCH_SSHASH, BENCH_IDS };
+
+static void bench_loop(bench_strings kind, unsigned int n, std::vector<uint32_t>& lat)
+{
+	switch (kind) {
+	case BENCH_PLAIN:
+		timed(lat, dbglog(test_area, INFO, "plain bench 0-args"));
+		timed(lat, dbglog(test_area, DEBUG, "plain bench debug [%d] [%d]", n*100, n*200));
+		timed(lat, dbglog(test_area, WARN, "plain bench warn 2-str-args: [%s] [%s]", "abc", "xyz"));
+		timed(lat, dbglog(test_area, ERROR, "plain bench error 2-str-args: [%s] [%s]", "plain ABC info", "plain EDF info"));
+		timed(lat, dbglog(test_area, DEBUG, "plain bench debug 1-str-arg: [%s]", "plain XYZ info"));
+		timed(lat, dbglog(test_area, INFO, "plain bench special chars\"\"\'\'\t\\n~*?[];()}"));
+		break;
+
+	case BENCH_SSHASH:
+		timed(lat, dbglogss(test_area, INFO, "sensitive bench 0-args"));
+		timed(lat, dbglogss(test_area, DEBUG, "sensitive bench debug [%d] [%d]", n*100, n*200));
+		timed(lat, dbglogss(test_area, WARN, "sensitive bench warn 2-str-args: [%s] [%s]", "abc", "xyz"));
+		timed(lat, dbglogss(test_area, ERROR, "sensitive bench error 2-ssi-args: [%s] [%s]", __ssi("top secret ABC info"), __ssi("top secret EDF info")));
+		timed(lat, dbglogss(test_area, DEBUG, "sensitive bench debug 1-ssi-arg: [%s]", __ssi("top secret XYZ info")));
+		timed(lat, dbglogss(test_area, INFO, "sensitive bench special chars\"\"\'\'\t\\n~*?[];()}"));
+		break;
+
+	case BENCH_IDS:
+		timed(lat, dbglogss(test_area, INFO, "sensitive bench 0-args"));
+		timed(lat, dbglogss(test_area, DEBUG, "sensitive bench debug [%d] [%d]", n*100, n*200));
+		timed(lat, dbglogss(test_area, WARN, "sensitive bench warn 2-str-args: [%s] [%s]", "abc", "xyz"));
+		timed(lat, dbglogss(test_area, ERROR, "sensitive bench error 2-ssi-args: [%s] [%s]", __ssid("top secret ABC info"), __ssid("top secret EDF info")));
+		timed(lat, dbglogss(test_area, DEBUG, "sensitive bench debug 1-ssi-arg: [%s]", __ssid("top secret XYZ info")));
+		timed(lat, dbglogss(test_area, INFO, "sensitive bench special chars\"\"\'\'\t\\n~*?[];()}"));
+		break;
+	}
+}
+
+struct bench_options {
+	unsigned int nthreads;
+	unsigned int nloops;   // per thread
+	unsigned int ring;     // ring capacity (records)
+	std::string  output;
+	std::string  ids_file; // string ID table for decoding (may not exist)
+	sshash::resolver *res; // map for decoding
+};
+
+struct bench_result {
+	uint64_t records;
+	double   producer_sec;  // until all producers are done posting
+	double   total_sec;     // until everything is written
+	std::vector<uint32_t> lat; // post latencies of all threads
+	double   decode_ns;     // mean decode cost per record (decode pipeline only)
+	uint64_t decode_max_ns;
+};
+
+static void bench_run(const bench_options& o, bench_strings kind, const std::string& pipeline, bench_result& r)
+{
+	std::unique_ptr<hogl::format_raw>   raw;
+	std::unique_ptr<sshash::ssformat>   dec;
+	std::unique_ptr<hogl::format_basic> basic;
+	hogl::format *lf;
+	if (pipeline == "raw") {
+		raw.reset(new hogl::format_raw());
+		lf = raw.get();
+	} else if (pipeline == "decode") {
+		dec.reset(new sshash::ssformat(*o.res, "fast1", false, true /* timing */));
+		std::shared_ptr<sshash::id_table> ids(new sshash::id_table);
+		if (kind == BENCH_IDS && sshash::load_ids(o.ids_file, *ids))
+			dec->set_ids(ids);
+		lf = dec.get();
+	} else {
+		basic.reset(new hogl::format_basic("fast1"));
+		lf = basic.get();
+	}
+
+	hogl::output_plainfile lo(o.output.c_str(), *lf);
+	hogl::activate(lo);
+
+	test_area = hogl::add_area(sshash_str("TEST-AREA"));
+	hogl::mask logmask(".*", 0);
+	hogl::apply_mask(logmask);
+
+	std::vector<std::vector<uint32_t> > lat(o.nthreads);
+	std::atomic<unsigned int> ready(0);
+	std::atomic<bool> go(false);
+
+	std::vector<std::thread> producers;
+	for (unsigned int t = 0; t < o.nthreads; t++) {
+		producers.push_back(std::thread([&, t]() {
+			std::string name = "BENCH-" + std::to_string(t);
+			hogl::ringbuf::options ring_opts = { o.ring, 0, hogl::ringbuf::BLOCKING, 256 };
+			hogl::tls tls(name.c_str(), ring_opts);
+
+			lat[t].reserve((size_t) o.nloops * bench_records);
+			ready++;
+			while (!go)
+				std::this_thread::yield();
+
+			for (unsigned int n = 0; n < o.nloops; n++)
+				bench_loop(kind, n, lat[t]);
+		}));
+	}
+
+	while (ready != o.nthreads)
+		std::this_thread::yield();
+
+	uint64_t t0 = now_ns();
+	go = true;
+	for (auto &p : producers)
+		p.join();
+	uint64_t t1 = now_ns();
+
+	hogl::deactivate();
+	uint64_t t2 = now_ns();
+
+	r.records      = (uint64_t) o.nthreads * o.nloops * bench_records;
+	r.producer_sec = (t1 - t0) / 1e9;
+	r.total_sec    = (t2 - t0) / 1e9;
+	r.decode_ns    = 0;
+	r.decode_max_ns = 0;
+	if (dec && dec->stats().latency_count) {
+		r.decode_ns     = (double) dec->stats().latency_sum / dec->stats().latency_count;
+		r.decode_max_ns = dec->stats().latency_max;
+	}
+
+	r.lat.clear();
+	for (auto &l : lat)
+		r.lat.insert(r.lat.end(), l.begin(), l.end());
+	std::sort(r.lat.begin(), r.lat.end());
+}
+
+static uint32_t percentile(const std::vector<uint32_t>& v, double q)
+{
+	if (v.empty())
+		return 0;
+	size_t i = (size_t) (q * v.size());
+	return v[std::min(i, v.size() - 1)];
+}
+
+// sshash_str() strings are replaced with (shorter) digests in a hashed binary
+static bool binary_hashed()
+{
+	return strlen(sshash_str("HOGL-TEST-HASHED-BINARY-PROBE")) != sizeof("HOGL-TEST-HASHED-BINARY-PROBE") - 1;
+}
+
+static int bench(const bench_options& o)
+{
+	static const char *kinds[] = { "plain", "sshash", "sshash-ids" };
+	static const char *pipelines[] = { "basic", "raw", "decode" };
+
+	printf("hogl logging benchmark: %s binary, %u threads, %llu records per run, output %s\n",
+		binary_hashed() ? "hashed" : "unhashed", o.nthreads,
+		(unsigned long long) o.nthreads * o.nloops * bench_records, o.output.c_str());
+	printf("%-10s %-8s %12s %12s %8s %8s %8s %8s %10s %10s\n", "strings", "pipeline",
+		"producer/s", "total/s", "p50-ns", "p90-ns", "p99-ns", "p999-ns", "max-ns", "decode-ns");
+
+	for (unsigned int k = 0; k < 3; k++) {
+		for (unsigned int p = 0; p < 3; p++) {
+			// format_basic would pass the IDs to %s conversions as strings
+			if (k == BENCH_IDS && !strcmp(pipelines[p], "basic")) {
+				printf("%-10s %-8s %12s %12s %8s %8s %8s %8s %10s %10s\n", kinds[k], pipelines[p],
+					"-", "-", "-", "-", "-", "-", "-", "-");
+				continue;
+			}
+
+			bench_result r;
+			bench_run(o, (bench_strings) k, pipelines[p], r);
+
+			char decode[32] = "-";
+			if (r.decode_ns)
+				snprintf(decode, sizeof(decode), "%.1f", r.decode_ns);
+
+			printf("%-10s %-8s %12.0f %12.0f %8u %8u %8u %8u %10u %10s\n", kinds[k], pipelines[p],
+				r.records / r.producer_sec, r.records / r.total_sec,
+				percentile(r.lat, 0.5), percentile(r.lat, 0.9), percentile(r.lat, 0.99),
+				percentile(r.lat, 0.999), r.lat.empty() ? 0 : r.lat.back(), decode);
+			fflush(stdout);
+		}
+	}
+	return 0;
+}
+
 // Command line args {
 static struct option main_lopts[] = {
    {"help",    0, 0, 'h'},
    {"nloops",  1, 0, 'N'},
    {"log-format",  1, 0, 'f'},
    {"log-output",  1, 0, 'o'},
+   {"ids",     0, 0, 'i'},
+   {"timing",  0, 0, 't'},
+   {"bench",   0, 0, 'b'},
+   {"threads", 1, 0, 'T'},
+   {"hashmap", 1, 0, 'm'},
+   {"ring",    1, 0, 'r'},
    {0, 0, 0, 0}
 };
 
-static char main_sopts[] = "hN:f:o:";
+static char main_sopts[] = "hN:f:o:itbT:m:r:";
 
 static char main_help[] =
    "SSHASH basic test 0.1 \n"
@@ -105,6 +339,13 @@ static char main_help[] =
       "\t--help -h            Display help text\n"
       "\t--log-format -f <name>   Log format (basic, raw)\n"
       "\t--log-output -o <name>   Log output (file name, stderr, pipe)\n"
+      "\t--nloops -N <count>      Number of test loops\n"
+      "\t--ids -i                 Log sensitive string args as string IDs (raw format only)\n"
+      "\t--timing -t              Report logging cost on stderr\n"
+      "\t--bench -b               Run the multi-threaded logging throughput benchmark\n"
+      "\t--threads -T <count>     Number of producer threads (bench)\n"
+      "\t--hashmap -m <file>      Hash map for the decode pipeline (bench)\n"
+      "\t--ring -r <count>        Per-thread ring capacity in records (bench)\n"
       "";
 // }
 
@@ -112,9 +353,18 @@ int main(int argc, char *argv[])
 {
 	std::string log_output("stdout");
 	std::string log_format("fast1");
-	unsigned int nloops = 1;
+	unsigned int nloops = 0;
+	bool timing = false;
+	bool do_bench = false;
 	int opt;
 
+	bench_options bo;
+	bo.nthreads = 4;
+	bo.ring     = 16 * 1024;
+	bo.res      = nullptr;
+	bo.ids_file = std::string(argv[0]) + ".sshash-ids";
+	std::string hashmap;
+
 	// Parse command line args
 	while ((opt = getopt_long(argc, argv, main_sopts, main_lopts, NULL)) != -1) {
 		switch (opt) {
@@ -130,6 +380,30 @@ int main(int argc, char *argv[])
 			nloops = atoi(optarg);
 			break;
 
+		case 'i':
+			use_ids = true;
+			break;
+
+		case 't':
+			timing = true;
+			break;
+
+		case 'b':
+			do_bench = true;
+			break;
+
+		case 'T':
+			bo.nthreads = atoi(optarg);
+			break;
+
+		case 'm':
+			hashmap = optarg;
+			break;
+
+		case 'r':
+			bo.ring = atoi(optarg);
+			break;
+
 		case 'h':
 		default:
 			printf("%s", main_help);
@@ -145,6 +419,28 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
+	// Only the raw format keeps the IDs for decoding, format_basic would
+	// pass them to %s conversions as strings
+	if (use_ids && log_format != "raw") {
+		fprintf(stderr, "--ids requires --log-format raw\n");
+		exit(1);
+	}
+
+	if (do_bench) {
+		sshash::resolver res;
+		if (!hashmap.empty() && !res.load(hashmap)) {
+			fprintf(stderr, "failed to load hashmap %s\n", hashmap.c_str());
+			exit(1);
+		}
+		bo.res      = &res;
+		bo.nloops   = nloops ? nloops : 20000;
+		bo.output   = log_output == "stdout" ? "/dev/null" : log_output;
+		return bench(bo);
+	}
+
+	if (!nloops)
+		nloops = 1;
+
 	hogl::format *lf;
 	hogl::output *lo;
 
@@ -170,10 +466,22 @@ int main(int argc, char *argv[])
 
 	hogl::apply_mask(logmask);
 
+	struct timespec t0, t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
 	doTest(nloops);
 
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
 	hogl::deactivate();
 
+	if (timing) {
+		double ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+		unsigned int n = nloops * loop_records;
+		fprintf(stderr, "posted %u records in %.3f msec: %.1f nsec per record (%s)\n",
+			n, ns / 1e6, n ? ns / n : 0.0, use_ids ? "string ids" : "strings");
+	}
+
 	delete lo;
 	delete lf;
 
@@ -0,0 +1,129 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <type_traits>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+#include "sshash/macros.hpp"
+
+// String IDs test.
+// Without arguments, checks that every ID refers to its literal in the .sshash.str section
+// (by length and checksum, a plain copy of the literal would show up as a leak).
+// With the ID table written by sshash-elf --ids, checks that the table maps each ID to
+// the digest that replaced the literal.
+
+static constexpr uint32_t fnv1a(const char *s, size_t n, uint32_t h = 2166136261u)
+{
+	return n ? fnv1a(s + 1, n - 1, (h ^ (unsigned char) *s) * 16777619u) : h;
+}
+
+struct test_id {
+	uint32_t id;
+	uint32_t sum;
+	size_t   len;
+};
+
+#define make_test_id(str) test_id{ sshash_id(str), \
+	std::integral_constant<uint32_t, fnv1a(str, sizeof(str) - 1)>::value, sizeof(str) - 1 }
+
+static std::vector<test_id> get_ids()
+{
+	std::vector<test_id> v;
+	v.push_back(make_test_id("id-test first secret"));
+	v.push_back(make_test_id("id-test second secret, a bit longer than the first one"));
+	v.push_back(make_test_id("short"));
+	v.push_back(make_test_id("id-test %s format string %u"));
+	// Escapes and prefixes that the assembler would read differently
+	v.push_back(make_test_id("id-test at \\@ sign"));
+	v.push_back(make_test_id("id-test regex \\(a\\)\\() x"));
+	v.push_back(make_test_id("id-test don\'t, \"quoted\"\t\\n"));
+	v.push_back(make_test_id(u8"id-test café \\@ utf-8"));
+	v.push_back(make_test_id("id-test last secret"));
+	return v;
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<test_id> ids = get_ids();
+
+	for (size_t i = 0; i < ids.size(); i++) {
+		const char *s = __sshash_str_start + ids[i].id;
+		std::cout << "id " << ids[i].id << " [" << s << "]\n";
+		if (!*s) {
+			std::cerr << "id " << ids[i].id << " does not point to a string\n";
+			exit(1);
+		}
+		for (size_t k = 0; k < i; k++) {
+			if (ids[k].id == ids[i].id) {
+				std::cerr << "duplicate id " << ids[i].id << "\n";
+				exit(1);
+			}
+		}
+		if (argc < 2 && (strlen(s) != ids[i].len || fnv1a(s, ids[i].len) != ids[i].sum)) {
+			std::cerr << "id " << ids[i].id << " does not point to its literal\n";
+			exit(1);
+		}
+	}
+
+	if (argc < 2) {
+		std::cout << "all ids are valid\n";
+		return 0;
+	}
+
+	boost::property_tree::ptree table;
+	try {
+		boost::property_tree::json_parser::read_json(argv[1], table);
+	} catch (std::exception &e) {
+		std::cerr << "failed to load id table: " << e.what() << "\n";
+		exit(1);
+	}
+
+	for (auto &t : ids) {
+		uint32_t id = t.id;
+		std::string digest = table.get<std::string>(std::to_string(id), std::string());
+		if (digest != __sshash_str_start + id) {
+			std::cerr << "id " << id << " maps to [" << digest << "] instead of [" << __sshash_str_start + id << "]\n";
+			exit(1);
+		}
+	}
+
+	std::cout << "all ids match\n";
+	return 0;
+}
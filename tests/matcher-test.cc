@@ -0,0 +1,171 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "sshash/matcher.hpp"
+
+// Checks sshash::matcher against a brute force leftmost-longest replacement
+// on random patterns and texts over a small alphabet (lots of overlaps),
+// and checks that searching a buffer in ranges gives the same matches.
+
+typedef std::vector<sshash::matcher::match> match_list;
+
+// Brute force leftmost-longest replacement
+static std::string reference(const std::vector<std::string>& from, const std::vector<std::string>& to, const std::string& text)
+{
+	std::string out;
+	size_t i = 0;
+	while (i < text.size()) {
+		int best = -1;
+		for (size_t p = 0; p < from.size(); p++)
+			if (!text.compare(i, from[p].size(), from[p]) &&
+					(best < 0 || from[p].size() > from[best].size()))
+				best = p;
+		if (best < 0) {
+			out += text[i++];
+			continue;
+		}
+		out += to[best];
+		i += from[best].size();
+	}
+	return out;
+}
+
+// Search in ranges and fix up the seams: a range whose start is covered by
+// the last match of the previous ranges is searched again from the end of that match
+static match_list find_ranges(const sshash::matcher& m, const std::string& text, size_t rsize)
+{
+	match_list all, r;
+	size_t cursor = 0;
+	for (size_t b = 0; b < text.size(); b += rsize) {
+		size_t e = std::min(text.size(), b + rsize);
+		r.clear();
+		m.find(text.data(), text.size(), std::max(b, cursor), e, r);
+		for (auto &x : r)
+			all.push_back(x);
+		if (!r.empty())
+			cursor = r.back().start + r.back().len;
+	}
+	return all;
+}
+
+static std::string random_string(std::mt19937& rng, size_t maxlen)
+{
+	static const char alpha[] = "abc\n";
+	std::string s(1 + rng() % maxlen, 0);
+	for (auto &c : s)
+		c = alpha[rng() % (sizeof(alpha) - 1)];
+	return s;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int niters = 2000;
+	if (argc > 1)
+		niters = atoi(argv[1]);
+
+	std::mt19937 rng(1234);
+
+	for (unsigned int it = 0; it < niters; it++) {
+		sshash::map map;
+		std::vector<std::string> strs, digests;
+		unsigned int n = 1 + rng() % 12;
+		for (unsigned int i = 0; i < n; i++) {
+			std::string s = random_string(rng, 6);
+			char d[16];
+			snprintf(d, sizeof(d), "H%07u", i);
+			if (!map.update(d, s, "matcher-test"))
+				continue;
+			strs.push_back(s);
+			digests.push_back(d);
+		}
+
+		// Duplicate strings map to the first digest
+		std::vector<std::string> from, to;
+		for (size_t i = 0; i < strs.size(); i++) {
+			bool dup = false;
+			for (size_t j = 0; j < i; j++)
+				dup |= strs[j] == strs[i];
+			if (!dup) {
+				from.push_back(strs[i]);
+				to.push_back(digests[i]);
+			}
+		}
+
+		std::string text = random_string(rng, 300);
+
+		sshash::matcher hm(map, sshash::matcher::HASH);
+		if (!hm.valid()) {
+			std::cerr << "failed to build matcher\n";
+			return 1;
+		}
+
+		std::string out;
+		hm.replace(text.data(), text.size(), out);
+		std::string ref = reference(from, to, text);
+		if (out != ref) {
+			std::cerr << "hash mismatch: text [" << text << "]\n  got [" << out << "]\n  ref [" << ref << "]\n";
+			return 1;
+		}
+
+		match_list whole;
+		hm.find(text.data(), text.size(), 0, text.size(), whole);
+		for (size_t rsize : { 1, 3, 7, 64 }) {
+			match_list parts = find_ranges(hm, text, rsize);
+			bool same = parts.size() == whole.size();
+			for (size_t i = 0; same && i < parts.size(); i++)
+				same = parts[i].start == whole[i].start && parts[i].len == whole[i].len;
+			if (!same) {
+				std::cerr << "range search mismatch (range size " << rsize << "): text [" << text << "]\n";
+				return 1;
+			}
+		}
+
+		// Unhashing restores the text (digests never occur in it)
+		sshash::matcher um(map, sshash::matcher::UNHASH);
+		std::string back;
+		um.replace(out.data(), out.size(), back);
+		std::string unref = reference(digests, strs, out);
+		if (back != unref) {
+			std::cerr << "unhash mismatch: text [" << out << "]\n";
+			return 1;
+		}
+	}
+
+	std::cout << "matcher test passed: " << niters << " iterations\n";
+	return 0;
+}
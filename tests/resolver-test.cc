@@ -0,0 +1,346 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+#include "sshash/resolver.hpp"
+
+// Stress test for sshash::resolver.
+// Reader threads resolve digests continuously while a writer publishes new
+// generations of the map. Every generation maps the same digests to strings
+// tagged with the generation number, which lets readers check that they never
+// see a torn or stale-after-newer snapshot.
+
+static const unsigned int nstrings = 4096;
+
+static std::vector<std::string> digests;
+static std::vector<std::string> suffixes;
+
+static void make_digests()
+{
+	char d[16];
+	for (unsigned int i = 0; i < nstrings; i++) {
+		snprintf(d, sizeof(d), "h%07u", i);
+		digests.push_back(d);
+		suffixes.push_back(" string " + std::to_string(i));
+	}
+}
+
+// Strings are "<gen> string <i>"
+static void make_map(sshash::map& m, unsigned int gen)
+{
+	for (unsigned int i = 0; i < nstrings; i++)
+		m.update(digests[i], std::to_string(gen) + suffixes[i], "resolver-test");
+}
+
+// Check the string for digest i and extract its generation
+static bool check_string(const std::string& s, unsigned int i, unsigned int& gen)
+{
+	const std::string& sfx = suffixes[i];
+	if (s.size() <= sfx.size() || s.compare(s.size() - sfx.size(), sfx.size(), sfx))
+		return false;
+	gen = 0;
+	for (size_t n = 0; n < s.size() - sfx.size(); n++) {
+		if (s[n] < '0' || s[n] > '9')
+			return false;
+		gen = gen * 10 + (s[n] - '0');
+	}
+	return true;
+}
+
+static double thread_cpu_time()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+struct reader_stats {
+	uint64_t lookups;
+	uint64_t errors;
+	uint64_t refreshes;
+	double   cpu;
+};
+
+static void reader_thread(const sshash::resolver& r, const std::atomic<bool>& done,
+		const std::atomic<unsigned int>& published, unsigned int seed, reader_stats& st)
+{
+	sshash::resolver::reader rd(r);
+	unsigned int last_gen = 0;
+	uint64_t last_version = rd.version();
+
+	st.lookups = st.errors = st.refreshes = 0;
+	double cpu = thread_cpu_time();
+
+	while (!done.load(std::memory_order_relaxed)) {
+		seed = seed * 1103515245 + 12345;
+		unsigned int i = (seed >> 8) % nstrings;
+		const std::string& d = digests[i];
+
+		const std::string* s = rd.lookup(d);
+		st.lookups++;
+
+		if (rd.version() != last_version) {
+			last_version = rd.version();
+			st.refreshes++;
+		}
+
+		unsigned int gen;
+		if (!s || !check_string(*s, i, gen) || gen < last_gen || gen > published.load(std::memory_order_acquire)) {
+			std::cerr << "bad string for " << d << ": " << (s ? *s : "(null)") << " (last gen " << last_gen << ")\n";
+			st.errors++;
+			continue;
+		}
+		last_gen = gen;
+
+		// Unknown digests must not resolve
+		if (!(st.lookups & 0xfff) && rd.lookup("unknown!", 8)) {
+			std::cerr << "unknown digest resolved\n";
+			st.errors++;
+		}
+	}
+
+	st.cpu = thread_cpu_time() - cpu;
+}
+
+static bool run(sshash::resolver& r, unsigned int nthreads, const std::vector<sshash::map>& maps,
+		std::atomic<unsigned int>& published)
+{
+	unsigned int npublish = maps.size();
+	std::atomic<bool> done(false);
+	std::vector<reader_stats> stats(nthreads);
+	std::vector<std::thread> threads;
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (unsigned int t = 0; t < nthreads; t++)
+		threads.emplace_back(reader_thread, std::cref(r), std::cref(done), std::cref(published), t + 1, std::ref(stats[t]));
+
+	if (npublish) {
+		// Maps are built upfront, publishing includes building the snapshot
+		for (unsigned int n = 0; n < npublish; n++) {
+			unsigned int g = published.load() + 1;
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			// Bump the expected generation first, readers may see the new map right away
+			published.store(g, std::memory_order_release);
+			r.publish(maps[n]);
+		}
+	} else
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+
+	done = true;
+	for (auto& t : threads)
+		t.join();
+
+	double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	uint64_t lookups = 0, errors = 0, refreshes = 0;
+	double cpu = 0;
+	for (auto& s : stats) {
+		lookups   += s.lookups;
+		errors    += s.errors;
+		refreshes += s.refreshes;
+		cpu       += s.cpu;
+	}
+
+	printf("%u readers, %u publishes, %.2f sec: %llu lookups, %llu refreshes, %llu errors, %.1f ns/lookup\n",
+		nthreads, npublish, secs, (unsigned long long) lookups, (unsigned long long) refreshes,
+		(unsigned long long) errors, lookups ? cpu * 1e9 / lookups : 0.0);
+
+	return errors == 0;
+}
+
+// Hot reload of the map file
+static bool watch_test()
+{
+	char path[] = "/tmp/resolver-test.XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		return false;
+	}
+	close(fd);
+
+	sshash::map m1, m2;
+	make_map(m1, 1);
+	make_map(m2, 2);
+
+	bool ok = false;
+	sshash::resolver r;
+	std::string s;
+
+	if (!m1.save(path) || !r.load(path))
+		goto out;
+	r.watch(path, 10);
+
+	// Partially written map must not replace the current one
+	{
+		FILE *f = fopen(path, "w");
+		fputs("{ \"h0000042\": { \"str\": \"", f);
+		fclose(f);
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	if (!r.lookup("h0000042", s) || s != "1 string 42") {
+		std::cerr << "partial map was published: [" << s << "]\n";
+		goto out;
+	}
+
+	if (!m2.save(path))
+		goto out;
+	for (unsigned int i = 0; i < 500 && !ok; i++) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		ok = r.lookup("h0000042", s) && s == "2 string 42";
+	}
+	if (!ok)
+		std::cerr << "map was not reloaded: [" << s << "]\n";
+
+	// Background initial load
+	{
+		sshash::resolver lr;
+		lr.watch(path, 0);
+		if (!lr.wait_ready() || !lr.lookup("h0000042", s) || s != "2 string 42") {
+			std::cerr << "background load failed\n";
+			ok = false;
+		}
+
+		sshash::resolver fr;
+		fr.watch(std::string(path) + ".missing", 0);
+		if (fr.wait_ready()) {
+			std::cerr << "background load of a missing map succeeded\n";
+			ok = false;
+		}
+
+		// Map created after the initial load failed is picked up by the polling
+		std::string late = std::string(path) + ".late";
+		sshash::resolver wr;
+		wr.watch(late, 10);
+		if (wr.wait_ready()) {
+			std::cerr << "background load of a missing map succeeded\n";
+			ok = false;
+		}
+		bool found = false;
+		if (m1.save(late)) {
+			for (unsigned int i = 0; i < 500 && !found; i++) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+				found = wr.lookup("h0000042", s) && s == "1 string 42";
+			}
+		}
+		if (!found) {
+			std::cerr << "map created after the initial load was not loaded\n";
+			ok = false;
+		}
+		wr.unwatch();
+		unlink(late.c_str());
+	}
+
+out:
+	r.unwatch();
+	unlink(path);
+	return ok;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int nthreads = 4;
+	unsigned int npublish = 20;
+
+	if (argc > 1)
+		nthreads = atoi(argv[1]);
+	if (argc > 2)
+		npublish = atoi(argv[2]);
+
+	make_digests();
+
+	sshash::resolver r;
+	std::atomic<unsigned int> published(1);
+
+	std::vector<sshash::map> maps(npublish + 1);
+	for (unsigned int g = 0; g <= npublish; g++)
+		make_map(maps[g], g + 1);
+
+	r.publish(maps[0]);
+
+	std::string s;
+	if (!r.lookup("h0000042", s) || s != "1 string 42") {
+		std::cerr << "lookup failed: [" << s << "]\n";
+		return 1;
+	}
+
+	// Digest shape checks
+	sshash::resolver::snapshot_ptr snap = r.get();
+	const char *rejects[] = { "h000004", "h00000420", "0h000042", "h000004!", "" };
+	for (const char *x : rejects)
+		if (snap->resolve(x)) {
+			std::cerr << "non-digest resolved: [" << x << "]\n";
+			return 1;
+		}
+	if (!snap->resolve("h0000042") || snap->resolve("h0000042x") || snap->resolve("H0000042")) {
+		std::cerr << "resolve failed\n";
+		return 1;
+	}
+	// Digests embedded in text
+	std::string text = "key h0000042, h0000043x (h0000044)h0000045", out;
+	if (snap->replace(text.data(), text.size(), out) != 3 ||
+			out != "key 1 string 42, h0000043x (1 string 44)1 string 45") {
+		std::cerr << "replace failed: [" << out << "]\n";
+		return 1;
+	}
+	text = "no digests here: h000004 0h0000042";
+	if (snap->replace(text.data(), text.size(), out)) {
+		std::cerr << "replace failed: [" << out << "]\n";
+		return 1;
+	}
+	snap.reset();
+
+	// Steady state lookups
+	if (!run(r, nthreads, std::vector<sshash::map>(), published))
+		return 1;
+
+	// Lookups while new maps are being published
+	maps.erase(maps.begin());
+	if (!run(r, nthreads, maps, published))
+		return 1;
+
+	if (!watch_test())
+		return 1;
+
+	printf("all lookups ok\n");
+	return 0;
+}
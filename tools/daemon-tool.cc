@@ -0,0 +1,618 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <thread>
+
+#include "sshash/map.hpp"
+#include "sha.hpp"
+#include "elf-io.hpp"
+#include "elf-hash.hpp"
+#include "elf-stats.hpp"
+#include "daemon.hpp"
+
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+static po::variables_map optmap;
+
+static bool opt_verbose = false;
+static volatile sig_atomic_t stop_signal = 0;
+
+static void handle_signal(int)
+{
+	stop_signal = 1;
+}
+
+static uint64_t now_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Client connection
+struct connection {
+	enum { MAX_LINE = 1024 * 1024 };
+
+	int         fd;
+	std::string in;
+	std::string out;
+	bool        eof;    // no more requests
+	bool        failed; // drop without flushing replies
+
+	explicit connection(int f) : fd(f), eof(false), failed(false) {}
+	~connection() { close(fd); }
+};
+
+// Request received in this round
+struct request {
+	connection *conn;
+	std::string cmd;
+	std::string arg;
+};
+
+// Resident map server.
+// Single threaded event loop: all requests that arrived since the last round
+// are handled together (digests for all 'hash' requests are generated in one
+// batch on the worker threads), then the map is updated in arrival order.
+class server {
+public:
+	server(const std::string& mapfile, unsigned int minlen, unsigned int jobs, unsigned int checkpoint) :
+		_mapfile(mapfile), _sha(minlen), _hasher(_map, _sha, _stats),
+		_listen(-1), _checkpoint_ms(checkpoint * 1000ull), _saved_new(0), _last_save(0),
+		_shutdown(false), _requests(0), _rounds(0)
+	{
+		_hasher.set_verbose(opt_verbose);
+		_hasher.set_jobs(jobs);
+	}
+
+	~server()
+	{
+		if (_listen >= 0) {
+			close(_listen);
+			unlink(_socket.c_str());
+		}
+	}
+
+	sshash::elf_stats& stats() { return _stats; }
+	size_t map_size() const { return _map.size(); }
+
+	bool load();
+	bool listen(const std::string& path);
+	bool run();
+	bool save();
+
+private:
+	bool dirty() const { return _stats.map_new != _saved_new; }
+
+	void accept_clients();
+	void read_client(connection& c);
+	void write_client(connection& c);
+	void process(std::vector<request>& reqs);
+	std::string do_elf(const std::string& arg);
+	std::string do_stats();
+
+	std::string       _mapfile;
+	std::string       _socket;
+	sshash::map       _map;
+	sshash::sha       _sha;
+	sshash::elf_stats _stats;
+	sshash::elf_hash_engine _hasher;
+
+	int      _listen;
+	uint64_t _checkpoint_ms;
+	uint64_t _saved_new;  // map_new at the last save
+	uint64_t _last_save;
+	bool     _shutdown;
+	uint64_t _requests;
+	uint64_t _rounds;
+
+	std::vector<std::unique_ptr<connection> > _conns;
+};
+
+bool server::load()
+{
+	sshash::elf_stats::scope load_phase(_stats, sshash::elf_stats::MAP_LOAD);
+
+	// A map that exists but fails to load must not be replaced by an empty one
+	struct stat st;
+	if (stat(_mapfile.c_str(), &st) == 0 && !_map.load(_mapfile))
+		return false;
+
+	_last_save = now_ms();
+	std::cout << "loaded " << _map.size() << " strings from " << _mapfile << "\n";
+	return true;
+}
+
+// Write the map to a temporary file and rename it, so that readers never see a partial map
+bool server::save()
+{
+	sshash::elf_stats::scope save_phase(_stats, sshash::elf_stats::MAP_SAVE);
+
+	std::string tmp = _mapfile + ".tmp";
+	if (!_map.save(tmp))
+		return false;
+	if (rename(tmp.c_str(), _mapfile.c_str()) < 0) {
+		std::cerr << _mapfile << " rename failed: " << strerror(errno) << "\n";
+		return false;
+	}
+
+	_saved_new = _stats.map_new;
+	_last_save = now_ms();
+	if (opt_verbose)
+		std::cout << "saved " << _map.size() << " strings to " << _mapfile << "\n";
+	return true;
+}
+
+bool server::listen(const std::string& path)
+{
+	struct sockaddr_un addr;
+	if (path.size() >= sizeof(addr.sun_path)) {
+		std::cerr << path << ": socket path is too long\n";
+		return false;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, path.c_str(), path.size());
+
+	_listen = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (_listen < 0) {
+		std::cerr << "socket failed: " << strerror(errno) << "\n";
+		return false;
+	}
+
+	int r = bind(_listen, (struct sockaddr *) &addr, sizeof(addr));
+	if (r < 0 && errno == EADDRINUSE) {
+		// Remove the socket left behind by a daemon that is gone, but never
+		// take over from one that is still running
+		int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		bool running = probe >= 0 && connect(probe, (struct sockaddr *) &addr, sizeof(addr)) == 0;
+		if (probe >= 0)
+			close(probe);
+		if (running) {
+			std::cerr << path << ": another daemon is running\n";
+			close(_listen);
+			_listen = -1;
+			return false;
+		}
+		unlink(path.c_str());
+		r = bind(_listen, (struct sockaddr *) &addr, sizeof(addr));
+	}
+	if (r < 0 || ::listen(_listen, 128) < 0) {
+		std::cerr << path << ": listen failed: " << strerror(errno) << "\n";
+		close(_listen);
+		_listen = -1;
+		return false;
+	}
+
+	_socket = path;
+	return true;
+}
+
+void server::accept_clients()
+{
+	for (;;) {
+		int fd = accept4(_listen, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+				std::cerr << "accept failed: " << strerror(errno) << "\n";
+			return;
+		}
+		_conns.push_back(std::unique_ptr<connection>(new connection(fd)));
+	}
+}
+
+void server::read_client(connection& c)
+{
+	char buf[64 * 1024];
+	for (;;) {
+		ssize_t r = read(c.fd, buf, sizeof(buf));
+		if (r > 0) {
+			c.in.append(buf, r);
+			continue;
+		}
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r == 0)
+			c.eof = true;
+		else if (errno != EAGAIN && errno != EWOULDBLOCK)
+			c.failed = true;
+		return;
+	}
+}
+
+void server::write_client(connection& c)
+{
+	while (!c.out.empty()) {
+		ssize_t r = send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				c.failed = true;
+			return;
+		}
+		c.out.erase(0, r);
+	}
+}
+
+std::string server::do_elf(const std::string& arg)
+{
+	// elf [dryrun] [ids] <path>
+	std::string path = arg;
+	bool dryrun = false, ids = false;
+	for (;;) {
+		if (!path.compare(0, 7, "dryrun ")) {
+			dryrun = true;
+			path.erase(0, 7);
+		} else if (!path.compare(0, 4, "ids ")) {
+			ids = true;
+			path.erase(0, 4);
+		} else
+			break;
+	}
+	path = sshash::daemon_unescape(path);
+	if (path.empty())
+		return "err missing path";
+
+	uint64_t strings = _stats.strings_hashed;
+	uint64_t added   = _stats.map_new;
+
+	std::ostringstream err;
+	std::ostream       nowhere(nullptr);
+	std::ostream      &out = opt_verbose ? std::cout : nowhere;
+
+	sshash::elf_file f;
+	_hasher.set_ids(ids);
+	bool ok = f.load(path, _stats, err);
+	if (ok && f.archive)
+		ok = _hasher.hash_archive(f, !dryrun, out, err);
+	else if (ok)
+		ok = _hasher.hash(f, out, err) && (dryrun || f.store(_stats, err));
+	if (!ok) {
+		std::string msg = err.str();
+		while (!msg.empty() && msg.back() == '\n')
+			msg.pop_back();
+		if (msg.empty())
+			msg = path + ": failed";
+		return "err " + sshash::daemon_escape(msg);
+	}
+
+	return "ok " + std::to_string(_stats.strings_hashed - strings) + " " + std::to_string(_stats.map_new - added);
+}
+
+std::string server::do_stats()
+{
+	std::ostringstream s;
+	s << "ok strings=" << _map.size()
+		<< " clients=" << _conns.size()
+		<< " requests=" << _requests
+		<< " rounds=" << _rounds
+		<< " files=" << _stats.files
+		<< " new=" << _stats.map_new
+		<< " existing=" << _stats.map_existing
+		<< " unsaved=" << (_stats.map_new - _saved_new);
+	return s.str();
+}
+
+void server::process(std::vector<request>& reqs)
+{
+	_rounds++;
+	_requests += reqs.size();
+
+	// Digests for all strings of this round
+	std::vector<std::string> strs;
+	for (auto &r : reqs)
+		if (r.cmd == "hash")
+			strs.push_back(sshash::daemon_unescape(r.arg));
+
+	std::vector<std::string> hashes;
+	{
+		sshash::elf_stats::scope hash_phase(_stats, sshash::elf_stats::HASH);
+		_hasher.digest(strs, hashes);
+		_stats.strings_hashed += strs.size();
+	}
+
+	// Handle the requests in order
+	size_t h = 0;
+	for (auto &r : reqs) {
+		std::string reply;
+
+		if (r.cmd == "hash") {
+			const std::string &str = strs[h];
+			const std::string &hash = hashes[h++];
+			std::ostringstream err;
+			sshash::elf_stats::scope update_phase(_stats, sshash::elf_stats::MAP_UPDATE);
+			if (str.empty())
+				reply = "err empty string";
+			else if (!_hasher.add(std::string(), hash, str, err))
+				reply = "err hash collision: " + hash;
+			else
+				reply = "ok " + hash;
+		} else if (r.cmd == "get") {
+			// Digests are alphanumeric, anything else is not a valid map path
+			bool valid = !r.arg.empty() && std::all_of(r.arg.begin(), r.arg.end(),
+				[](char c) { return isalnum((unsigned char) c); });
+			boost::optional<std::string> str;
+			if (valid)
+				str = _map.get_optional<std::string>(r.arg + ".str");
+			reply = str ? "ok " + sshash::daemon_escape(*str) : "err not found";
+		} else if (r.cmd == "elf") {
+			reply = do_elf(r.arg);
+		} else if (r.cmd == "save") {
+			reply = save() ? "ok" : "err save failed";
+		} else if (r.cmd == "stats") {
+			reply = do_stats();
+		} else if (r.cmd == "shutdown") {
+			_shutdown = true;
+			reply = "ok";
+		} else
+			reply = "err unknown request: " + r.cmd;
+
+		r.conn->out += reply;
+		r.conn->out += '\n';
+	}
+}
+
+bool server::run()
+{
+	// Signals are only delivered while waiting in ppoll()
+	sigset_t block, orig;
+	sigemptyset(&block);
+	sigaddset(&block, SIGINT);
+	sigaddset(&block, SIGTERM);
+	sigaddset(&block, SIGHUP);
+	sigprocmask(SIG_BLOCK, &block, &orig);
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handle_signal;
+	sigaction(SIGINT,  &sa, nullptr);
+	sigaction(SIGTERM, &sa, nullptr);
+	sigaction(SIGHUP,  &sa, nullptr);
+
+	bool ok = true;
+	std::vector<struct pollfd> pfd;
+
+	while (!stop_signal) {
+		// Stop once the shutdown reply has been delivered
+		if (_shutdown && std::none_of(_conns.begin(), _conns.end(),
+				[](const std::unique_ptr<connection>& c) { return !c->out.empty() && !c->failed; }))
+			break;
+
+		pfd.clear();
+		pfd.push_back(pollfd{_listen, (short) (_shutdown ? 0 : POLLIN), 0});
+		for (auto &c : _conns)
+			pfd.push_back(pollfd{c->fd, (short) ((c->eof ? 0 : POLLIN) | (c->out.empty() ? 0 : POLLOUT)), 0});
+
+		// Wake up for the next checkpoint
+		struct timespec ts, *tsp = nullptr;
+		if (dirty() && _checkpoint_ms) {
+			uint64_t due = _last_save + _checkpoint_ms, now = now_ms();
+			uint64_t wait = due > now ? due - now : 0;
+			ts.tv_sec  = wait / 1000;
+			ts.tv_nsec = (wait % 1000) * 1000000;
+			tsp = &ts;
+		}
+
+		int r = ppoll(pfd.data(), pfd.size(), tsp, &orig);
+		if (r < 0 && errno != EINTR) {
+			std::cerr << "poll failed: " << strerror(errno) << "\n";
+			ok = false;
+			break;
+		}
+
+		if (r > 0) {
+			if (pfd[0].revents & POLLIN)
+				accept_clients();
+
+			// Collect complete requests from all clients
+			std::vector<request> reqs;
+			for (size_t i = 1; i < pfd.size(); i++) {
+				connection &c = *_conns[i - 1];
+				if (pfd[i].revents & (POLLIN | POLLHUP | POLLERR))
+					read_client(c);
+
+				size_t start = 0, eol;
+				while ((eol = c.in.find('\n', start)) != std::string::npos) {
+					std::string line = c.in.substr(start, eol - start);
+					start = eol + 1;
+
+					request q;
+					q.conn = &c;
+					size_t sp = line.find(' ');
+					q.cmd = line.substr(0, sp);
+					if (sp != std::string::npos)
+						q.arg = line.substr(sp + 1);
+					reqs.push_back(q);
+				}
+				c.in.erase(0, start);
+
+				if (c.in.size() > connection::MAX_LINE) {
+					std::cerr << "request too long, dropping client\n";
+					c.failed = true;
+				}
+			}
+
+			if (!reqs.empty())
+				process(reqs);
+		}
+
+		for (auto &c : _conns)
+			if (!c->failed)
+				write_client(*c);
+
+		// Drop clients that are gone
+		_conns.erase(std::remove_if(_conns.begin(), _conns.end(),
+			[](const std::unique_ptr<connection>& c) { return c->failed || (c->eof && c->out.empty()); }),
+			_conns.end());
+
+		if (dirty() && _checkpoint_ms && now_ms() >= _last_save + _checkpoint_ms && !save())
+			_last_save = now_ms(); // retry after the next interval
+	}
+
+	sigprocmask(SIG_SETMASK, &orig, nullptr);
+
+	if (dirty() && !save())
+		ok = false;
+	return ok;
+}
+
+// Send requests to a running daemon and print the replies
+static bool client(const std::string& socket, const std::vector<std::string>& requests)
+{
+	sshash::daemon_client c;
+	if (!c.connect(socket))
+		return false;
+
+	bool ok = true;
+	auto send = [&](const std::string& req) {
+		std::string reply;
+		if (!c.request(req, reply))
+			return false;
+		std::cout << reply << "\n";
+		if (reply.compare(0, 2, "ok"))
+			ok = false;
+		return true;
+	};
+
+	if (!requests.empty()) {
+		for (auto &r : requests)
+			if (!send(r))
+				return false;
+	} else {
+		std::string line;
+		while (std::getline(std::cin, line))
+			if (!send(line))
+				return false;
+	}
+	return ok;
+}
+
+static bool write_stats(sshash::elf_stats& stats, const std::string& name, uint64_t map_entries)
+{
+	if (name == "-") {
+		stats.dump_json(std::cerr, map_entries);
+		return true;
+	}
+
+	std::ofstream f(name);
+	stats.dump_json(f, map_entries);
+	if (!f) {
+		std::cerr << name << " write failed\n";
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<std::string> requests;
+
+	// **** Parse command line arguments ****
+	po::options_description optdesc("sshash-daemon -- resident hash map server\n"
+				"Usage: sshash-daemon --socket path --hashmap map [options]\n"
+				"       sshash-daemon --socket path --client [requests]\n"
+				"Options");
+	optdesc.add_options()
+		("help", "Print this message")
+		("socket,s",   po::value<std::string>(), "Unix socket path")
+		("hashmap,m",  po::value<std::string>(), "Hash map file (loaded on start, saved on checkpoints and on exit)")
+		("minlen,L",   po::value<unsigned int>()->default_value(8), "Length of the hash value (aka min string length)")
+		("checkpoint", po::value<unsigned int>()->default_value(10), "Save the map this often (seconds) when it has new strings, 0 - only on exit")
+		("jobs,j",     po::value<unsigned int>()->default_value(0), "Number of worker threads for hashing (0 - number of CPUs)")
+		("stats",      po::value<std::string>(), "Write timing and resource stats as JSON to this file on exit (\"-\" for stderr)")
+		("client",     "Send requests (arguments, or lines from stdin) to a running daemon and print the replies")
+		("request",    po::value<std::vector<std::string> >(&requests)->composing(), "Client request")
+		("verbose",    "Show verbose info (processed files, digest values, etc)");
+
+	po::positional_options_description popt;
+	popt.add("request", -1);
+
+	po::store(po::command_line_parser(argc, argv).
+	          options(optdesc).positional(popt).run(), optmap);
+
+	po::notify(optmap);
+
+	if (optmap.count("help") || !optmap.count("socket")) {
+		std::cout << optdesc << std::endl;
+		return 1;
+	}
+
+	const std::string socket = optmap["socket"].as<std::string>();
+
+	if (optmap.count("client"))
+		return client(socket, requests) ? 0 : 1;
+
+	if (!optmap.count("hashmap")) {
+		std::cout << optdesc << std::endl;
+		return 1;
+	}
+
+	opt_verbose = optmap.count("verbose");
+	unsigned int jobs = optmap["jobs"].as<unsigned int>();
+	if (!jobs)
+		jobs = std::max(1u, std::thread::hardware_concurrency());
+
+	server srv(optmap["hashmap"].as<std::string>(), optmap["minlen"].as<unsigned int>(), jobs,
+		optmap["checkpoint"].as<unsigned int>());
+
+	if (optmap.count("stats"))
+		srv.stats().enable();
+
+	if (!srv.load() || !srv.listen(socket))
+		return 1;
+
+	std::cout << "listening on " << socket << std::endl;
+	bool ok = srv.run();
+
+	if (optmap.count("stats") && !write_stats(srv.stats(), optmap["stats"].as<std::string>(), srv.map_size()))
+		return 1;
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <iostream>
+
+#include "daemon.hpp"
+
+namespace sshash {
+
+std::string daemon_escape(const std::string& s)
+{
+	std::string r;
+	r.reserve(s.size());
+	for (char c : s) {
+		switch (c) {
+		case '\\': r += "\\\\"; break;
+		case '\n': r += "\\n";  break;
+		default:   r += c;      break;
+		}
+	}
+	return r;
+}
+
+std::string daemon_unescape(const std::string& s)
+{
+	std::string r;
+	r.reserve(s.size());
+	for (size_t i = 0; i < s.size(); i++) {
+		if (s[i] != '\\' || i + 1 == s.size()) {
+			r += s[i];
+			continue;
+		}
+		char c = s[++i];
+		r += c == 'n' ? '\n' : c;
+	}
+	return r;
+}
+
+daemon_client::~daemon_client()
+{
+	if (_fd >= 0)
+		::close(_fd);
+}
+
+bool daemon_client::connect(const std::string& path)
+{
+	struct sockaddr_un addr;
+	if (path.size() >= sizeof(addr.sun_path)) {
+		std::cerr << path << ": socket path is too long\n";
+		return false;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, path.c_str(), path.size());
+
+	_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (_fd < 0) {
+		std::cerr << "socket failed: " << strerror(errno) << "\n";
+		return false;
+	}
+	if (::connect(_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		std::cerr << path << ": connect failed: " << strerror(errno) << "\n";
+		::close(_fd);
+		_fd = -1;
+		return false;
+	}
+	return true;
+}
+
+bool daemon_client::request(const std::string& req, std::string& reply)
+{
+	std::string line = req + "\n";
+	for (size_t off = 0; off < line.size(); ) {
+		ssize_t r = send(_fd, line.data() + off, line.size() - off, MSG_NOSIGNAL);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r < 0) {
+			std::cerr << "daemon write failed: " << strerror(errno) << "\n";
+			return false;
+		}
+		off += r;
+	}
+
+	size_t eol;
+	while ((eol = _in.find('\n')) == std::string::npos) {
+		char buf[4096];
+		ssize_t r = ::read(_fd, buf, sizeof(buf));
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0) {
+			std::cerr << "daemon read failed: " << (r ? strerror(errno) : "connection closed") << "\n";
+			return false;
+		}
+		_in.append(buf, r);
+	}
+
+	reply = _in.substr(0, eol);
+	_in.erase(0, eol + 1);
+	return true;
+}
+
+} // namespace sshash
@@ -0,0 +1,87 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef SSHASH_DAEMON
+#define SSHASH_DAEMON
+
+#include <string>
+
+namespace sshash {
+
+// sshash-daemon protocol.
+// Requests and replies are single lines. Replies start with "ok" or "err",
+// followed by a space and the result or the error message. Strings and
+// paths are escaped (see daemon_escape()) so that they fit on one line.
+//
+//   hash <string>              -> ok <digest>
+//   get <digest>               -> ok <string>
+//   elf [dryrun] [ids] <path>  -> ok <strings> <new strings>
+//   save                       -> ok
+//   stats                      -> ok <key>=<value> ...
+//   shutdown                   -> ok
+//
+// 'elf' hashes the file in place (the path is opened by the daemon).
+// Requests from one connection are answered in order, and may be pipelined.
+
+// Escape '\' and newlines
+std::string daemon_escape(const std::string& s);
+
+// Undo daemon_escape()
+std::string daemon_unescape(const std::string& s);
+
+// Client connection to sshash-daemon
+class daemon_client {
+public:
+	daemon_client() : _fd(-1) {}
+	~daemon_client();
+
+	/**
+	 * Connect to the daemon
+	 * @param path Unix socket path
+	 * @return false on failure (reported on stderr)
+	 */
+	bool connect(const std::string& path);
+
+	/**
+	 * Send a request and wait for the reply
+	 * @param req request line (without the newline)
+	 * @param reply reply line (without the newline)
+	 * @return false if the connection failed (reported on stderr)
+	 */
+	bool request(const std::string& req, std::string& reply);
+
+private:
+	int         _fd;
+	std::string _in; // received data that is not consumed yet
+};
+
+} // namespace sshash
+
+#endif // SSHASH_DAEMON
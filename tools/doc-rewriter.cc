@@ -0,0 +1,553 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include <iostream>
+
+#include "doc-rewriter.hpp"
+
+namespace sshash {
+
+// ** Output file **
+
+bool out_file::open(const std::string& name)
+{
+	_name   = name;
+	_failed = false;
+	_fd = ::open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (_fd < 0) {
+		std::cerr << name << " open failed: " << strerror(errno) << "\n";
+		return false;
+	}
+	_buf.reserve(BUFSIZE);
+	return true;
+}
+
+bool out_file::close()
+{
+	if (_fd < 0)
+		return !_failed;
+	flush();
+	if (::close(_fd) < 0 && !_failed) {
+		std::cerr << _name << " write failed: " << strerror(errno) << "\n";
+		_failed = true;
+	}
+	_fd = -1;
+	return !_failed;
+}
+
+void out_file::flush()
+{
+	write(_buf.data(), _buf.size());
+	_buf.clear();
+}
+
+void out_file::write(const char *data, size_t len)
+{
+	while (len && !_failed) {
+		ssize_t n = ::write(_fd, data, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			std::cerr << _name << " write failed: " << strerror(errno) << "\n";
+			_failed = true;
+			break;
+		}
+		data += n;
+		len  -= n;
+	}
+}
+
+// ** Decoding helpers **
+
+static void put_utf8(uint32_t c, std::string& out)
+{
+	if (c < 0x80)
+		out += (char) c;
+	else if (c < 0x800) {
+		out += (char) (0xc0 | (c >> 6));
+		out += (char) (0x80 | (c & 0x3f));
+	} else if (c < 0x10000) {
+		out += (char) (0xe0 | (c >> 12));
+		out += (char) (0x80 | ((c >> 6) & 0x3f));
+		out += (char) (0x80 | (c & 0x3f));
+	} else {
+		out += (char) (0xf0 | (c >> 18));
+		out += (char) (0x80 | ((c >> 12) & 0x3f));
+		out += (char) (0x80 | ((c >> 6) & 0x3f));
+		out += (char) (0x80 | (c & 0x3f));
+	}
+}
+
+static int hex_digit(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+static bool parse_hex4(const char *s, const char *e, uint32_t& v)
+{
+	if (e - s < 4)
+		return false;
+	v = 0;
+	for (int i = 0; i < 4; i++) {
+		int d = hex_digit(s[i]);
+		if (d < 0)
+			return false;
+		v = v << 4 | d;
+	}
+	return true;
+}
+
+// Decode JSON string contents (without the quotes)
+// Fails on bad escapes and if the string is longer than limit.
+static bool json_decode(const char *s, const char *e, std::string& out, size_t limit)
+{
+	out.clear();
+	while (s < e) {
+		if (out.size() > limit)
+			return false;
+		char c = *s++;
+		if (c != '\\') {
+			out += c;
+			continue;
+		}
+		if (s == e)
+			return false;
+		c = *s++;
+		switch (c) {
+		case '"':  out += '"';  break;
+		case '\\': out += '\\'; break;
+		case '/':  out += '/';  break;
+		case 'b':  out += '\b'; break;
+		case 'f':  out += '\f'; break;
+		case 'n':  out += '\n'; break;
+		case 'r':  out += '\r'; break;
+		case 't':  out += '\t'; break;
+		case 'u': {
+			uint32_t v, lo;
+			if (!parse_hex4(s, e, v))
+				return false;
+			s += 4;
+			// Surrogate pair
+			if (v >= 0xd800 && v < 0xdc00 && e - s >= 6 && s[0] == '\\' && s[1] == 'u' &&
+					parse_hex4(s + 2, e, lo) && lo >= 0xdc00 && lo < 0xe000) {
+				v = 0x10000 + ((v - 0xd800) << 10) + (lo - 0xdc00);
+				s += 6;
+			}
+			put_utf8(v, out);
+			break;
+		}
+		default:
+			return false;
+		}
+	}
+	return out.size() <= limit;
+}
+
+// Decode XML character data (entities and character references)
+// Fails on unknown entities and if the string is longer than limit.
+static bool xml_decode(const char *s, const char *e, std::string& out, size_t limit)
+{
+	out.clear();
+	while (s < e) {
+		if (out.size() > limit)
+			return false;
+		char c = *s++;
+		if (c != '&') {
+			out += c;
+			continue;
+		}
+		const char *semi = (const char *) memchr(s, ';', e - s);
+		if (!semi)
+			return false;
+		std::string ent(s, semi - s);
+		s = semi + 1;
+		if (ent == "amp")       out += '&';
+		else if (ent == "lt")   out += '<';
+		else if (ent == "gt")   out += '>';
+		else if (ent == "quot") out += '"';
+		else if (ent == "apos") out += '\'';
+		else if (ent.size() > 1 && ent[0] == '#') {
+			char *end;
+			unsigned long v = ent[1] == 'x' ? strtoul(ent.c_str() + 2, &end, 16) : strtoul(ent.c_str() + 1, &end, 10);
+			if (*end || v > 0x10ffff)
+				return false;
+			put_utf8(v, out);
+		} else
+			return false;
+	}
+	return out.size() <= limit;
+}
+
+static bool is_xml_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// ** Rewriter **
+
+doc_rewriter::doc_rewriter(const map& m, bool hash) : _maxlen(0), _replaced(0)
+{
+	for (auto &e : m) {
+		std::string str = e.second.get<std::string>("str", std::string());
+		const std::string &from = hash ? str : e.first;
+		const std::string &to   = hash ? e.first : str;
+		if (from.empty())
+			continue;
+		_table.emplace(from, to);
+		if (from.size() > _maxlen)
+			_maxlen = from.size();
+	}
+}
+
+const std::string* doc_rewriter::lookup(std::string& s, char& prefix) const
+{
+	prefix = 0;
+	if (!s.empty() && (s[0] == '#' || s[0] == '@')) {
+		prefix = s[0];
+		s.erase(0, 1);
+	}
+	auto it = _table.find(s);
+	return it == _table.end() ? nullptr : &it->second;
+}
+
+bool doc_rewriter::fail(const char *what, size_t offset)
+{
+	_error = std::string(what) + " at offset " + std::to_string(offset);
+	return false;
+}
+
+void doc_rewriter::put_json_string(char prefix, const std::string& s, out_file& out) const
+{
+	static const char hex[] = "0123456789abcdef";
+	out.put('"');
+	if (prefix)
+		out.put(prefix);
+	for (char c : s) {
+		switch (c) {
+		case '"':  out.put("\\\"", 2); break;
+		case '\\': out.put("\\\\", 2); break;
+		case '\b': out.put("\\b", 2); break;
+		case '\f': out.put("\\f", 2); break;
+		case '\n': out.put("\\n", 2); break;
+		case '\r': out.put("\\r", 2); break;
+		case '\t': out.put("\\t", 2); break;
+		default:
+			if ((unsigned char) c < 0x20) {
+				char u[] = { '\\', 'u', '0', '0', hex[(c >> 4) & 0xf], hex[c & 0xf] };
+				out.put(u, sizeof(u));
+			} else
+				out.put(c);
+		}
+	}
+	out.put('"');
+}
+
+bool doc_rewriter::rewrite_json(const char *data, size_t len, out_file& out)
+{
+	size_t p   = 0; // scan position
+	size_t run = 0; // start of the input that is not copied yet
+
+	// Only strings (keys and values) are of interest.
+	// Everything between strings is copied as is.
+	while (p < len) {
+		const char *q = (const char *) memchr(data + p, '"', len - p);
+		if (!q)
+			break;
+
+		size_t s = q - data;
+		size_t e = s + 1;
+		while (e < len && data[e] != '"')
+			e += data[e] == '\\' ? 2 : 1;
+		if (e >= len)
+			return fail("unterminated string", s);
+
+		char prefix;
+		const std::string *r = nullptr;
+		if (json_decode(data + s + 1, data + e, _tmp, _maxlen + 1))
+			r = lookup(_tmp, prefix);
+		if (r) {
+			out.put(data + run, s - run);
+			put_json_string(prefix, *r, out);
+			run = e + 1;
+			_replaced++;
+		}
+		p = e + 1;
+	}
+
+	out.put(data + run, len - run);
+	return true;
+}
+
+void doc_rewriter::put_xml_escaped(const std::string& s, char quote, out_file& out) const
+{
+	for (char c : s) {
+		switch (c) {
+		case '&': out.put("&amp;", 5); break;
+		case '<': out.put("&lt;", 4); break;
+		case '>': out.put("&gt;", 4); break;
+		case '"':
+			if (quote == '"')
+				out.put("&quot;", 6);
+			else
+				out.put(c);
+			break;
+		case '\'':
+			if (quote == '\'')
+				out.put("&apos;", 6);
+			else
+				out.put(c);
+			break;
+		default:
+			out.put(c);
+		}
+	}
+}
+
+// Element or attribute name
+bool doc_rewriter::xml_name(const char *data, size_t len, size_t& p, out_file& out)
+{
+	size_t s = p;
+	while (p < len && !is_xml_space(data[p]) && data[p] != '>' && data[p] != '/' && data[p] != '=')
+		p++;
+	if (p == s)
+		return fail("missing name", s);
+
+	char prefix;
+	_tmp.assign(data + s, p - s);
+	const std::string *r = lookup(_tmp, prefix);
+	if (r) {
+		if (prefix)
+			out.put(prefix);
+		out.put(*r);
+		_replaced++;
+	} else
+		out.put(data + s, p - s);
+	return true;
+}
+
+// Character data between tags.
+// Matched after trimming whitespace (like xmltodict does), the whitespace is kept.
+void doc_rewriter::xml_text(const char *data, size_t begin, size_t end, out_file& out)
+{
+	size_t a = begin, b = end;
+	while (a < b && is_xml_space(data[a]))
+		a++;
+	while (b > a && is_xml_space(data[b - 1]))
+		b--;
+
+	char prefix;
+	const std::string *r = nullptr;
+	if (a < b && xml_decode(data + a, data + b, _tmp, _maxlen + 1))
+		r = lookup(_tmp, prefix);
+	if (!r) {
+		out.put(data + begin, end - begin);
+		return;
+	}
+
+	out.put(data + begin, a - begin);
+	if (prefix)
+		out.put(prefix);
+	put_xml_escaped(*r, 0, out);
+	out.put(data + b, end - b);
+	_replaced++;
+}
+
+// Markup starting at data[p] == '<'
+bool doc_rewriter::xml_tag(const char *data, size_t len, size_t& p, out_file& out)
+{
+	const size_t s = p;
+	const char *rest = data + p;
+	const size_t avail = len - p;
+
+	// Copy through the first occurrence of term
+	auto copy_until = [&](const char *term, const char *what) {
+		const char *e = (const char *) memmem(data + p, len - p, term, strlen(term));
+		if (!e)
+			return fail(what, s);
+		size_t n = e - data + strlen(term);
+		out.put(data + p, n - p);
+		p = n;
+		return true;
+	};
+
+	if (avail >= 4 && !memcmp(rest, "<!--", 4))
+		return copy_until("-->", "unterminated comment");
+
+	if (avail >= 9 && !memcmp(rest, "<![CDATA[", 9)) {
+		const char *e = (const char *) memmem(rest + 9, avail - 9, "]]>", 3);
+		if (!e)
+			return fail("unterminated CDATA", s);
+		size_t a = p + 9, b = e - data;
+		size_t ta = a, tb = b;
+		while (ta < tb && is_xml_space(data[ta]))
+			ta++;
+		while (tb > ta && is_xml_space(data[tb - 1]))
+			tb--;
+
+		char prefix;
+		const std::string *r = nullptr;
+		if (ta < tb && tb - ta <= _maxlen + 1) {
+			_tmp.assign(data + ta, tb - ta);
+			r = lookup(_tmp, prefix);
+		}
+		if (r) {
+			out.put(data + p, ta - p);
+			if (prefix)
+				out.put(prefix);
+			// "]]>" cannot appear inside CDATA, split the section around it
+			for (size_t i = 0; i < r->size(); i++) {
+				if (!r->compare(i, 3, "]]>")) {
+					out.put("]]]]><![CDATA[>", 15);
+					i += 2;
+				} else
+					out.put((*r)[i]);
+			}
+			out.put(data + tb, b + 3 - tb);
+			_replaced++;
+		} else
+			out.put(data + p, b + 3 - p);
+		p = b + 3;
+		return true;
+	}
+
+	if (avail >= 2 && rest[1] == '?')
+		return copy_until("?>", "unterminated processing instruction");
+
+	if (avail >= 2 && rest[1] == '!') {
+		// DOCTYPE and friends, may have an internal subset in []
+		int depth = 0;
+		for (size_t i = p + 2; i < len; i++) {
+			char c = data[i];
+			if (c == '[')
+				depth++;
+			else if (c == ']')
+				depth--;
+			else if (c == '>' && depth <= 0) {
+				out.put(data + p, i + 1 - p);
+				p = i + 1;
+				return true;
+			}
+		}
+		return fail("unterminated declaration", s);
+	}
+
+	if (avail >= 2 && rest[1] == '/') {
+		// End tag
+		out.put("</", 2);
+		p += 2;
+		if (!xml_name(data, len, p, out))
+			return false;
+		return copy_until(">", "unterminated end tag");
+	}
+
+	// Start tag
+	out.put('<');
+	p++;
+	if (!xml_name(data, len, p, out))
+		return false;
+
+	while (p < len) {
+		char c = data[p];
+		if (c == '>') {
+			out.put(c);
+			p++;
+			return true;
+		}
+		if (c == '/' || is_xml_space(c)) {
+			out.put(c);
+			p++;
+			continue;
+		}
+
+		// Attribute
+		if (!xml_name(data, len, p, out))
+			return false;
+		while (p < len && is_xml_space(data[p]))
+			out.put(data[p++]);
+		if (p >= len || data[p] != '=')
+			return fail("expected '=' after attribute name", p);
+		out.put(data[p++]);
+		while (p < len && is_xml_space(data[p]))
+			out.put(data[p++]);
+		if (p >= len || (data[p] != '"' && data[p] != '\''))
+			return fail("expected quoted attribute value", p);
+
+		char quote = data[p];
+		const char *e = (const char *) memchr(data + p + 1, quote, len - p - 1);
+		if (!e)
+			return fail("unterminated attribute value", p);
+		size_t a = p + 1, b = e - data;
+
+		char prefix;
+		const std::string *r = nullptr;
+		if (xml_decode(data + a, data + b, _tmp, _maxlen + 1))
+			r = lookup(_tmp, prefix);
+		if (r) {
+			out.put(quote);
+			if (prefix)
+				out.put(prefix);
+			put_xml_escaped(*r, quote, out);
+			out.put(quote);
+			_replaced++;
+		} else
+			out.put(data + p, b + 1 - p);
+		p = b + 1;
+	}
+
+	return fail("unterminated start tag", s);
+}
+
+bool doc_rewriter::rewrite_xml(const char *data, size_t len, out_file& out)
+{
+	size_t p = 0;
+	while (p < len) {
+		const char *lt = (const char *) memchr(data + p, '<', len - p);
+		size_t t = lt ? lt - data : len;
+		if (t > p)
+			xml_text(data, p, t, out);
+		if (!lt)
+			break;
+		p = t;
+		if (!xml_tag(data, len, p, out))
+			return false;
+	}
+	return true;
+}
+
+} // namespace sshash
@@ -0,0 +1,143 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef SSHASH_DOC_REWRITER
+#define SSHASH_DOC_REWRITER
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <unordered_map>
+
+#include "sshash/map.hpp"
+
+namespace sshash {
+
+// Buffered file writer with a fixed size buffer
+class out_file {
+public:
+	out_file() : _fd(-1), _failed(false) {}
+	~out_file() { close(); }
+
+	bool open(const std::string& name);
+	bool close();
+
+	void put(const char *data, size_t len)
+	{
+		if (_buf.size() + len > BUFSIZE)
+			flush();
+		if (len > BUFSIZE)
+			write(data, len);
+		else
+			_buf.append(data, len);
+	}
+
+	void put(const std::string& s) { put(s.data(), s.size()); }
+	void put(char c) { put(&c, 1); }
+
+private:
+	enum { BUFSIZE = 1024 * 1024 };
+
+	void flush();
+	void write(const char *data, size_t len);
+
+	std::string _name;
+	std::string _buf;
+	int         _fd;
+	bool        _failed;
+};
+
+// Format preserving JSON and XML rewriter.
+// Replaces keys and string values (JSON), and element names, attribute names,
+// attribute values and text (XML) that exactly match a map string (or digest
+// when unhashing), the same way sshash-text does. Everything else, including
+// whitespace, comments and the original escaping, is copied through byte for byte.
+// Input is processed in a single pass over a memory buffer. Memory use does not
+// depend on the input size: strings longer than the longest map string are
+// never decoded.
+class doc_rewriter {
+public:
+	/**
+	 * Build the rewriter from the hash map
+	 * @param m hash map ({ digest: { str, elf } })
+	 * @param hash true to replace strings with digests, false for the reverse
+	 */
+	doc_rewriter(const map& m, bool hash);
+
+	/**
+	 * Rewrite JSON document
+	 * @param data input buffer
+	 * @param len input buffer length
+	 * @param out output file
+	 * @return false if the document is malformed (see error())
+	 */
+	bool rewrite_json(const char *data, size_t len, out_file& out);
+
+	/**
+	 * Rewrite XML document
+	 * @param data input buffer
+	 * @param len input buffer length
+	 * @param out output file
+	 * @return false if the document is malformed (see error())
+	 */
+	bool rewrite_xml(const char *data, size_t len, out_file& out);
+
+	// Number of strings replaced so far
+	size_t replaced() const { return _replaced; }
+
+	// Description of the last error
+	const std::string& error() const { return _error; }
+
+private:
+	// Lookup a decoded string, '#' and '@' prefixes are kept as is (like sshash-text does)
+	const std::string* lookup(std::string& s, char& prefix) const;
+
+	bool fail(const char *what, size_t offset);
+
+	// JSON
+	void put_json_string(char prefix, const std::string& s, out_file& out) const;
+
+	// XML
+	bool xml_name(const char *data, size_t len, size_t& p, out_file& out);
+	bool xml_tag(const char *data, size_t len, size_t& p, out_file& out);
+	void xml_text(const char *data, size_t begin, size_t end, out_file& out);
+	void put_xml_escaped(const std::string& s, char quote, out_file& out) const;
+
+	std::unordered_map<std::string, std::string> _table;
+	size_t      _maxlen;   // longest string in the table
+	size_t      _replaced;
+	std::string _tmp;      // decoded string
+	std::string _error;
+};
+
+} // namespace sshash
+
+#endif // SSHASH_DOC_REWRITER
@@ -0,0 +1,458 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#include <string.h>
+
+#include <string>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <thread>
+
+#include "elf-hash.hpp"
+#include "string-parser.hpp"
+
+namespace sshash {
+
+elf_hash_engine::elf_hash_engine(map& m, sha& s, elf_stats& stats) :
+	_map(m), _sha(s), _stats(stats),
+	_verbose(false), _ids(false), _jobs(1), _frag(nullptr),
+	_out(&std::cout), _err(&std::cerr)
+{}
+
+// Add string to the map.
+// Returns false on hash collision.
+bool elf_hash_engine::update_map(const std::string& infile, const std::string& hash, const std::string& str)
+{
+	std::ostream &err = *_err;
+
+	if (!_map.update(hash, str, infile)) {
+		std::string s = _map.get<std::string>(hash + ".str");
+		if (s.compare(str) != 0) {
+			err << infile << ": hash collision: " << hash << " [" << str << "] [" << s << "]\n";
+			return false;
+		}
+		_stats.map_existing++;
+	} else
+		_stats.map_new++;
+
+	if (_frag)
+		_frag->update(hash, str, infile);
+	return true;
+}
+
+// Check for a string that is already replaced by its digest (object files
+// hashed before linking end up next to unhashed ones in the final binary)
+// or left over from an earlier run, see set_fragment())
+bool elf_hash_engine::hashed(const char *p, size_t n) const
+{
+	if (n != _sha.size())
+		return false;
+	std::string hash(p, n);
+	return _map.find(hash) != _map.not_found() || (_frag && _frag->find(hash) != _frag->not_found());
+}
+
+void elf_hash_engine::add_hashed(const std::string& infile, const std::string& hash)
+{
+	_stats.map_existing++;
+	if (_frag && _frag->find(hash) == _frag->not_found())
+		_frag->update(hash, _map.get<std::string>(hash + ".str"), infile);
+}
+
+// Add string ID (offset in the .sshash.str section, see sshash_id()) to the ID table
+void elf_hash_engine::add_id(map& ids, const elf_parser::section_t& s, uint64_t offset, const std::string& hash)
+{
+	if (_ids && s.section_name == ".sshash.str")
+		ids.put(std::to_string(offset), hash);
+}
+
+// String found by the string parser
+struct parsed_string {
+	std::string str;
+	uint64_t    offset;
+	size_t      room;
+	bool        hashed;
+};
+
+bool elf_hash_engine::process_section(map& ids, elf_file& f, unsigned int k)
+{
+	std::ostream &out = *_out;
+	std::ostream &err = *_err;
+
+	const elf_parser::section_t &s = f.strsect[k];
+	std::vector<char> &data = f.data[k];
+
+	out << "processing section: " << s.section_name << "\n";
+
+	// For each string in section, generate hash, store hash to string mapping,
+	// and replace the string with hash value.
+
+	std::vector<parsed_string> strs;
+	{
+		elf_stats::scope phase(_stats, elf_stats::SCAN);
+
+		string_parser sp(data.data(), data.size(), s.section_offset);
+		_stats.sections++;
+		_stats.bytes_scanned += data.size();
+
+		parsed_string p;
+		while (sp.next(p.str, p.offset, p.room)) {
+			if (p.room < _sha.size()) {
+				err << " not enough room for digest. missing pad???\n";
+				return false;
+			}
+			p.hashed = hashed(p.str.data(), p.str.size());
+			strs.push_back(p);
+		}
+	}
+
+	// Hash the strings
+	std::vector<std::string> hashes(strs.size());
+	{
+		elf_stats::scope phase(_stats, elf_stats::HASH);
+		for (size_t i = 0; i < strs.size(); i++) {
+			if (strs[i].hashed)
+				hashes[i] = strs[i].str;
+			else {
+				_sha.digest(hashes[i], strs[i].str);
+				_stats.strings_hashed++;
+			}
+		}
+	}
+
+	// Update the map and replace the strings
+	elf_stats::scope phase(_stats, elf_stats::MAP_UPDATE);
+	for (size_t i = 0; i < strs.size(); i++) {
+		if (_verbose) {
+			out << "string:"
+				<< std::hex << " offset: " << strs[i].offset
+				<< std::dec << " room: "   << strs[i].room
+				<< " [" << strs[i].str << "]\n";
+			out << "digest: " << hashes[i] << " [" << strs[i].str << "]\n";
+		}
+
+		add_id(ids, s, strs[i].offset - s.section_offset, hashes[i]);
+		if (strs[i].hashed) {
+			add_hashed(f.name, hashes[i]);
+			continue;
+		}
+		if (!update_map(f.name, hashes[i], strs[i].str))
+			return false;
+
+		char *p = data.data() + (strs[i].offset - s.section_offset);
+		memcpy(p, hashes[i].data(), hashes[i].size());
+		memset(p + hashes[i].size(), 0, strs[i].room - hashes[i].size());
+	}
+
+	return true;
+}
+
+
+// String descriptor from the .sshash.meta section (see sshash/macros.hpp).
+// ELF64 layout: 64-bit address, 32-bit length, 32-bit room.
+struct string_desc {
+	enum { SIZE = 16 };
+
+	uint64_t addr;
+	uint32_t len;
+	uint32_t room;
+
+	bool operator<(const string_desc& d) const { return addr < d.addr; }
+};
+
+// String section loaded into memory
+struct string_section {
+	const elf_parser::section_t *s;
+	std::vector<char> *data;
+
+	char* at(uint64_t addr) { return data->data() + (addr - s->section_addr); }
+
+	bool contains(uint64_t addr, uint64_t size) const
+	{
+		return addr >= (uint64_t) s->section_addr && addr + size <= (uint64_t) s->section_addr + data->size();
+	}
+};
+
+static bool all_zeros(const char *p, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		if (p[i])
+			return false;
+	return true;
+}
+
+// Run fn(begin, end) over [0, n) split into contiguous ranges, one per worker thread
+template <typename F>
+static void run_workers(unsigned int jobs, size_t n, F fn)
+{
+	size_t njobs = std::max<size_t>(1, std::min<size_t>(jobs, n));
+	size_t step  = (n + njobs - 1) / njobs;
+
+	std::vector<std::thread> workers;
+	for (size_t i = 1; i < njobs; i++)
+		workers.push_back(std::thread(fn, std::min(n, i * step), std::min(n, (i + 1) * step)));
+	fn(0, std::min(n, step));
+	for (auto &w : workers)
+		w.join();
+}
+
+// Process .sshash.str sections using the string descriptors.
+// Returns 1 on success, -1 on error, and 0 if the descriptors do not cover
+// all strings (objects built without descriptors), in which case the caller
+// falls back to the string parser.
+int elf_hash_engine::process_meta(map& ids, elf_file& f)
+{
+	std::ostream &out = *_out;
+	std::ostream &err = *_err;
+
+	elf_stats::scope scan_phase(_stats, elf_stats::SCAN);
+
+	const std::string &infile = f.name;
+	const std::vector<elf_parser::section_t> &strsect = f.strsect;
+	const std::vector<char> &raw = f.meta_data;
+
+	// Parse descriptors
+
+	std::vector<string_desc> descs;
+	for (size_t i = 0; i + string_desc::SIZE <= raw.size(); i += string_desc::SIZE) {
+		string_desc d;
+		memcpy(&d.addr, &raw[i],      8);
+		memcpy(&d.len,  &raw[i + 8],  4);
+		memcpy(&d.room, &raw[i + 12], 4);
+
+		// Strings removed by the linker (--gc-sections) have zero address
+		if (d.addr)
+			descs.push_back(d);
+	}
+	std::sort(descs.begin(), descs.end());
+
+	// String sections
+	std::vector<string_section> ss(strsect.size());
+	std::vector<std::pair<uint64_t, unsigned int> > byaddr;
+	for (unsigned int i = 0; i < strsect.size(); i++) {
+		ss[i].s    = &strsect[i];
+		ss[i].data = &f.data[i];
+		byaddr.push_back(std::make_pair((uint64_t) strsect[i].section_addr, i));
+	}
+	std::sort(byaddr.begin(), byaddr.end());
+
+	// Validate the descriptors against the section content.
+	// Identical strings folded by the linker share one address.
+	std::vector<string_desc>  strs;
+	std::vector<unsigned int> sect;
+	std::vector<bool>         done; // already hashed
+	for (auto &d : descs) {
+		if (!strs.empty() && strs.back().addr == d.addr) {
+			if (strs.back().len != d.len || strs.back().room != d.room) {
+				err << infile << std::hex << ": conflicting descriptors for string @" << d.addr << std::dec << "\n";
+				return -1;
+			}
+			continue;
+		}
+		if (!strs.empty() && strs.back().addr + strs.back().room > d.addr) {
+			err << infile << std::hex << ": overlapping strings @" << strs.back().addr << " and @" << d.addr << std::dec << "\n";
+			return -1;
+		}
+
+		auto it = std::upper_bound(byaddr.begin(), byaddr.end(), std::make_pair(d.addr, ~0u));
+		unsigned int k = it != byaddr.begin() ? (it - 1)->second : 0;
+		if (!ss[k].contains(d.addr, d.room)) {
+			err << infile << std::hex << ": string @" << d.addr << " is outside of .sshash.str sections" << std::dec << "\n";
+			return -1;
+		}
+
+		const char *p = ss[k].at(d.addr);
+		size_t n = strnlen(p, d.room);
+		bool is_hashed = hashed(p, n) && all_zeros(p + n, d.room - n);
+		if (!is_hashed && (!d.len || d.room < d.len || memchr(p, '\0', d.len) || !all_zeros(p + d.len, d.room - d.len))) {
+			err << infile << std::hex << ": string @" << d.addr << " does not match its descriptor (already hashed?)" << std::dec << "\n";
+			return -1;
+		}
+
+		if (d.room < _sha.size()) {
+			err << infile << std::hex << ": string @" << d.addr << " not enough room for digest" << std::dec << "\n";
+			return -1;
+		}
+
+		strs.push_back(d);
+		sect.push_back(k);
+		done.push_back(is_hashed);
+	}
+
+	// Everything outside of the described strings must be padding
+	std::vector<uint64_t> pos(ss.size());
+	for (unsigned int k = 0; k < ss.size(); k++)
+		pos[k] = ss[k].s->section_addr;
+
+	bool covered = true;
+	for (unsigned int i = 0; covered && i < strs.size(); i++) {
+		unsigned int k = sect[i];
+		covered = all_zeros(ss[k].at(pos[k]), strs[i].addr - pos[k]);
+		pos[k] = strs[i].addr + strs[i].room;
+	}
+	for (unsigned int k = 0; covered && k < ss.size(); k++)
+		covered = all_zeros(ss[k].at(pos[k]), ss[k].s->section_addr + ss[k].data->size() - pos[k]);
+
+	if (!covered) {
+		out << "warn: " << infile << " : contains strings without descriptors, using string parser\n";
+		return 0;
+	}
+
+	for (auto &s : ss) {
+		out << "processing section: " << s.s->section_name << "\n";
+		_stats.sections++;
+		_stats.bytes_scanned += s.data->size();
+	}
+	_stats.bytes_scanned += raw.size();
+	scan_phase.end();
+
+	if (_verbose)
+		out << "descriptors: " << descs.size() << " strings: " << strs.size() << "\n";
+
+	// Generate digests
+	elf_stats::scope hash_phase(_stats, elf_stats::HASH);
+	std::vector<std::string> hashes(strs.size());
+	run_workers(_jobs, strs.size(), [&](size_t b, size_t e) {
+		for (size_t i = b; i < e; i++) {
+			const char *p = ss[sect[i]].at(strs[i].addr);
+			if (done[i])
+				hashes[i].assign(p, _sha.size());
+			else
+				_sha.digest(hashes[i], p, strs[i].len);
+		}
+	});
+	_stats.strings_hashed += std::count(done.begin(), done.end(), false);
+	hash_phase.end();
+
+	// Update the map and replace the strings
+	elf_stats::scope update_phase(_stats, elf_stats::MAP_UPDATE);
+	for (unsigned int i = 0; i < strs.size(); i++) {
+		char *p = ss[sect[i]].at(strs[i].addr);
+		const std::string& hash = hashes[i];
+
+		if (done[i]) {
+			add_id(ids, *ss[sect[i]].s, strs[i].addr - ss[sect[i]].s->section_addr, hash);
+			add_hashed(infile, hash);
+			continue;
+		}
+
+		std::string str(p, strs[i].len);
+
+		if (_verbose) {
+			out << "string:"
+				<< std::hex << " addr: " << strs[i].addr
+				<< std::dec << " room: " << strs[i].room
+				<< " [" << str << "]\n";
+			out << "digest: " << hash << " [" << str << "]\n";
+		}
+
+		if (!update_map(infile, hash, str))
+			return -1;
+		add_id(ids, *ss[sect[i]].s, strs[i].addr - ss[sect[i]].s->section_addr, hash);
+
+		memcpy(p, hash.data(), hash.size());
+		memset(p + hash.size(), 0, strs[i].room - hash.size());
+	}
+
+	return 1;
+}
+
+bool elf_hash_engine::hash(elf_file& f, std::ostream& out, std::ostream& err)
+{
+	_out = &out;
+	_err = &err;
+
+	out << "processing " << f.name << "\n";
+	_stats.files++;
+
+	// Use descriptors if available, parse the padding otherwise.
+	// Descriptors of object files get their addresses at link time.
+	map ids;
+	int r = 0;
+	if (f.has_meta && !f.strsect.empty() && !f.relocatable)
+		r = process_meta(ids, f);
+	for (unsigned int i = 0; !r && i < f.strsect.size(); i++) {
+		if (!process_section(ids, f, i))
+			r = -1;
+	}
+
+	if (r < 0)
+		return false;
+
+	if (f.strsect.empty() && !f.relocatable)
+		out << "warn: " << f.name << " : does not contain .sshash.str sections\n";
+
+	// ID table for the strings of this ELF (IDs are assigned by the linker)
+	if (_ids && f.relocatable)
+		out << "warn: " << f.name << " : object file, no string ID table\n";
+	else if (_ids && !ids.save(f.name + ".sshash-ids"))
+		return false;
+
+	return true;
+}
+
+bool elf_hash_engine::hash_archive(elf_file& a, bool write, std::ostream& out, std::ostream& err)
+{
+	std::vector<ar_member> members;
+	{
+		elf_stats::scope parse_phase(_stats, elf_stats::ELF_PARSE);
+		if (!ar_members(a.fd, a.name, members, err))
+			return false;
+	}
+
+	out << "processing archive " << a.name << ": " << members.size() << " members\n";
+	_stats.files++;
+
+	for (auto &m : members) {
+		if (!m.elf) {
+			if (_verbose)
+				out << "skipping " << a.name << "(" << m.name << "): not an ELF object\n";
+			continue;
+		}
+
+		elf_file f;
+		if (!f.load_member(a, m, _stats, err) || !hash(f, out, err))
+			return false;
+		if (write && !f.store(_stats, err))
+			return false;
+	}
+	return true;
+}
+
+void elf_hash_engine::digest(const std::vector<std::string>& strs, std::vector<std::string>& hashes)
+{
+	hashes.resize(strs.size());
+	run_workers(_jobs, strs.size(), [&](size_t b, size_t e) {
+		for (size_t i = b; i < e; i++)
+			_sha.digest(hashes[i], strs[i]);
+	});
+}
+
+} // namespace sshash
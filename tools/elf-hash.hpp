@@ -0,0 +1,136 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef SSHASH_ELF_HASH
+#define SSHASH_ELF_HASH
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+#include "sshash/map.hpp"
+#include "sha.hpp"
+#include "elf-io.hpp"
+#include "elf-stats.hpp"
+
+namespace sshash {
+
+// Hashes the strings of ELF files loaded into memory (see elf_file) and
+// records them in the map. Used by sshash-elf, sshash-daemon and the public
+// sshash::elf_hasher (include/sshash/hasher.hpp).
+// Not thread-safe, a hasher is used by one thread at a time (it runs its
+// own worker threads for large files).
+class elf_hash_engine {
+public:
+	/**
+	 * @param m hash map to update
+	 * @param s digest generator
+	 * @param stats stats to account the work to
+	 */
+	elf_hash_engine(map& m, sha& s, elf_stats& stats);
+
+	// Show strings and digests
+	void set_verbose(bool v) { _verbose = v; }
+
+	// Write the string ID table (<file>.sshash-ids) of each file
+	void set_ids(bool ids) { _ids = ids; }
+
+	// Number of worker threads for hashing
+	void set_jobs(unsigned int jobs) { _jobs = jobs ? jobs : 1; }
+
+	// Also record the strings in this map (per-input map fragment), nullptr to stop.
+	// Digests that are already in the fragment are treated as hashed strings.
+	void set_fragment(map *frag) { _frag = frag; }
+
+	/**
+	 * Hash the strings of a loaded file.
+	 * The sections are updated in memory, the caller writes them back.
+	 * @param f file
+	 * @param out progress messages
+	 * @param err error messages
+	 * @return false on failure
+	 */
+	bool hash(elf_file& f, std::ostream& out, std::ostream& err);
+
+	/**
+	 * Hash the strings of all ELF members of an archive (in place, blocking I/O)
+	 * @param a archive (opened with elf_file::load())
+	 * @param write write the members back
+	 * @param out progress messages
+	 * @param err error messages
+	 * @return false on failure
+	 */
+	bool hash_archive(elf_file& a, bool write, std::ostream& out, std::ostream& err);
+
+	/**
+	 * Generate digests for a batch of strings (on the worker threads)
+	 * @param strs input strings
+	 * @param hashes output digests
+	 */
+	void digest(const std::vector<std::string>& strs, std::vector<std::string>& hashes);
+
+	/**
+	 * Add string to the map
+	 * @param elf name of the file the string comes from
+	 * @param hash digest of the string
+	 * @param str the string
+	 * @param err error messages
+	 * @return false on hash collision
+	 */
+	bool add(const std::string& elf, const std::string& hash, const std::string& str, std::ostream& err)
+	{
+		_err = &err;
+		return update_map(elf, hash, str);
+	}
+
+private:
+	bool update_map(const std::string& infile, const std::string& hash, const std::string& str);
+	bool hashed(const char *p, size_t n) const;
+	void add_hashed(const std::string& infile, const std::string& hash);
+	void add_id(map& ids, const elf_parser::section_t& s, uint64_t offset, const std::string& hash);
+	bool process_section(map& ids, elf_file& f, unsigned int k);
+	int  process_meta(map& ids, elf_file& f);
+
+	map&          _map;
+	sha&          _sha;
+	elf_stats&    _stats;
+	bool          _verbose;
+	bool          _ids;
+	unsigned int  _jobs;
+	map          *_frag;
+	std::ostream *_out;
+	std::ostream *_err;
+};
+
+} // namespace sshash
+
+#endif // SSHASH_ELF_HASH
@@ -0,0 +1,768 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <elf.h>
+#include <ar.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include <iostream>
+#include <memory>
+#include <deque>
+#include <algorithm>
+
+#include "elf-io.hpp"
+#include "uring.hpp"
+
+namespace sshash {
+
+void elf_file::add_section(const elf_parser::section_t& s)
+{
+	if (s.section_name == ".sshash.meta") {
+		meta = s;
+		has_meta = true;
+	} else if (s.section_name == ".sshash.range") {
+		range = s;
+		has_range = true;
+	} else if (s.section_name.find(".sshash.str") != std::string::npos) {
+		strsect.push_back(s);
+		data.push_back(std::vector<char>());
+	}
+}
+
+const char* elf_file::check_header(const Elf64_Ehdr& eh)
+{
+	if (memcmp(eh.e_ident, ELFMAG, SELFMAG))
+		return "not an ELF file";
+	if (eh.e_ident[EI_CLASS] != ELFCLASS64)
+		return "not a supported ELF64 file";
+	if (eh.e_shentsize != sizeof(Elf64_Shdr) || !eh.e_shnum || eh.e_shstrndx >= eh.e_shnum)
+		return "invalid section headers";
+	return nullptr;
+}
+
+void elf_file::add_sections(const Elf64_Ehdr& eh, const Elf64_Shdr *sh, const std::vector<char>& shstrtab, uint64_t base)
+{
+	relocatable = eh.e_type == ET_REL;
+
+	for (unsigned int i = 0; i < eh.e_shnum; i++) {
+		if (sh[i].sh_name >= shstrtab.size() - 1 || sh[i].sh_type == SHT_NOBITS)
+			continue;
+		elf_parser::section_t s;
+		s.section_index  = i;
+		s.section_name   = shstrtab.data() + sh[i].sh_name;
+		s.section_addr   = sh[i].sh_addr;
+		s.section_offset = base + sh[i].sh_offset;
+		s.section_size   = sh[i].sh_size;
+		s.section_ent_size   = sh[i].sh_entsize;
+		s.section_addr_align = sh[i].sh_addralign;
+		add_section(s);
+		if (sh[i].sh_flags & SHF_ALLOC)
+			_alloc.push_back(s);
+	}
+}
+
+const char* elf_file::add_range(const uint64_t r[2])
+{
+	if (!strsect.empty() || r[0] == r[1])
+		return nullptr;
+	if (r[0] > r[1])
+		return "invalid .sshash.range";
+
+	for (auto &a : _alloc) {
+		uint64_t addr = a.section_addr;
+		if (r[0] < addr || r[1] > addr + (uint64_t) a.section_size)
+			continue;
+		elf_parser::section_t s = a;
+		s.section_name   = ".sshash.str";
+		s.section_addr   = r[0];
+		s.section_offset = a.section_offset + (r[0] - addr);
+		s.section_size   = r[1] - r[0];
+		strsect.push_back(s);
+		data.push_back(std::vector<char>());
+		return nullptr;
+	}
+	return ".sshash.range is outside of the allocated sections";
+}
+
+bool elf_file::read_at(void *buf, size_t len, uint64_t off, std::ostream& err)
+{
+	if (_image) {
+		if (off > _image_size || len > _image_size - off) {
+			err << name << " read failed: unexpected end of image\n";
+			return false;
+		}
+		memcpy(buf, _image + off, len);
+		return true;
+	}
+
+	char *p = (char *) buf;
+	while (len) {
+		ssize_t r = pread(fd, p, len, off);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0) {
+			err << name << " read failed: " << (r ? strerror(errno) : "unexpected end of file") << "\n";
+			return false;
+		}
+		p += r; off += r; len -= r;
+	}
+	return true;
+}
+
+// Read the section headers of the ELF image at 'base'
+bool elf_file::parse(uint64_t base, std::ostream& err)
+{
+	Elf64_Ehdr eh;
+	if (!read_at(&eh, sizeof(eh), base, err))
+		return false;
+
+	const char *e = check_header(eh);
+	if (e) {
+		err << name << ": readelf failed: " << e << "\n";
+		return false;
+	}
+
+	std::vector<Elf64_Shdr> sh(eh.e_shnum);
+	if (!read_at(sh.data(), sh.size() * sizeof(Elf64_Shdr), base + eh.e_shoff, err))
+		return false;
+
+	const Elf64_Shdr &strtab = sh[eh.e_shstrndx];
+	std::vector<char> shstrtab(strtab.sh_size + 1, 0);
+	if (!read_at(shstrtab.data(), strtab.sh_size, base + strtab.sh_offset, err))
+		return false;
+
+	add_sections(eh, sh.data(), shstrtab, base);
+
+	if (has_range) {
+		uint64_t r[2];
+		if (range.section_size != sizeof(r)) {
+			err << name << ": readelf failed: invalid .sshash.range\n";
+			return false;
+		}
+		if (!read_at(r, sizeof(r), range.section_offset, err))
+			return false;
+		e = add_range(r);
+		if (e) {
+			err << name << ": readelf failed: " << e << "\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+bool elf_file::read_sections(elf_stats& stats, std::ostream& err)
+{
+	elf_stats::scope read_phase(stats, elf_stats::READ);
+	for (unsigned int i = 0; i < strsect.size(); i++) {
+		data[i].resize(strsect[i].section_size);
+		if (!read_at(data[i].data(), data[i].size(), strsect[i].section_offset, err))
+			return false;
+	}
+	if (has_meta) {
+		meta_data.resize(meta.section_size);
+		if (!read_at(meta_data.data(), meta_data.size(), meta.section_offset, err))
+			return false;
+	}
+	return true;
+}
+
+bool elf_file::load(const std::string& n, elf_stats& stats, std::ostream& err)
+{
+	name = n;
+
+	elf_stats::scope parse_phase(stats, elf_stats::ELF_PARSE);
+
+	// Open ELF file for reading and writing
+	fd = open(name.c_str(), O_RDWR);
+	if (fd < 0) {
+		err << name << " open failed: " << strerror(errno) << "\n";
+		return false;
+	}
+
+	char magic[SARMAG];
+	if (pread(fd, magic, SARMAG, 0) == SARMAG) {
+		if (!memcmp(magic, ARMAG, SARMAG)) {
+			archive = true;
+			return true;
+		}
+		if (!memcmp(magic, "!<thin>\n", SARMAG)) {
+			err << name << ": thin archives are not supported, process the member objects instead\n";
+			return false;
+		}
+	}
+
+	if (!parse(0, err))
+		return false;
+	parse_phase.end();
+
+	return read_sections(stats, err);
+}
+
+bool elf_file::load_image(const std::string& n, const char *image, size_t size, elf_stats& stats, std::ostream& err)
+{
+	name = n;
+	_image = image;
+	_image_size = size;
+
+	elf_stats::scope parse_phase(stats, elf_stats::ELF_PARSE);
+	if (size >= SARMAG && (!memcmp(image, ARMAG, SARMAG) || !memcmp(image, "!<thin>\n", SARMAG))) {
+		err << name << ": archives are not supported in memory\n";
+		return false;
+	}
+	if (!parse(0, err))
+		return false;
+	parse_phase.end();
+
+	return read_sections(stats, err);
+}
+
+void elf_file::store_image(char *image) const
+{
+	for (unsigned int i = 0; i < strsect.size(); i++)
+		memcpy(image + strsect[i].section_offset, data[i].data(), data[i].size());
+}
+
+bool elf_file::load_member(const elf_file& archive, const ar_member& m, elf_stats& stats, std::ostream& err)
+{
+	name = archive.name + "(" + m.name + ")";
+
+	elf_stats::scope parse_phase(stats, elf_stats::ELF_PARSE);
+	fd = dup(archive.fd);
+	if (fd < 0) {
+		err << name << " dup failed: " << strerror(errno) << "\n";
+		return false;
+	}
+	if (!parse(m.offset, err))
+		return false;
+
+	// Everything must be inside of the member
+	for (auto &s : strsect) {
+		if ((uint64_t) s.section_offset + (uint64_t) s.section_size > m.offset + m.size) {
+			err << name << ": readelf failed: section " << s.section_name << " is outside of the member\n";
+			return false;
+		}
+	}
+	parse_phase.end();
+
+	return read_sections(stats, err);
+}
+
+bool ar_members(int fd, const std::string& name, std::vector<ar_member>& out, std::ostream& err)
+{
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		err << name << " stat failed: " << strerror(errno) << "\n";
+		return false;
+	}
+	const uint64_t size = st.st_size;
+
+	std::string longnames; // GNU long name table
+	uint64_t off = SARMAG;
+	while (off + sizeof(struct ar_hdr) <= size) {
+		struct ar_hdr h;
+		if (pread(fd, &h, sizeof(h), off) != (ssize_t) sizeof(h) || memcmp(h.ar_fmag, ARFMAG, 2)) {
+			err << name << std::hex << ": malformed archive member header @" << off << std::dec << "\n";
+			return false;
+		}
+
+		uint64_t msize = strtoull(std::string(h.ar_size, sizeof(h.ar_size)).c_str(), nullptr, 10);
+		uint64_t mdata = off + sizeof(h);
+		if (mdata + msize > size) {
+			err << name << std::hex << ": truncated archive member @" << off << std::dec << "\n";
+			return false;
+		}
+		off = mdata + msize + (msize & 1);
+
+		std::string n(h.ar_name, sizeof(h.ar_name));
+		n.erase(n.find_last_not_of(' ') + 1);
+
+		// Symbol tables
+		if (n == "/" || n == "/SYM64/")
+			continue;
+
+		if (n == "//") {
+			longnames.resize(msize);
+			if (pread(fd, &longnames[0], msize, mdata) != (ssize_t) msize) {
+				err << name << " read failed: " << strerror(errno) << "\n";
+				return false;
+			}
+			continue;
+		}
+
+		ar_member m;
+		m.offset = mdata;
+		m.size   = msize;
+
+		if (n.size() > 1 && n[0] == '/' && isdigit((unsigned char) n[1])) {
+			// GNU long name: "/<offset in the long name table>"
+			size_t i = strtoul(n.c_str() + 1, nullptr, 10);
+			if (i >= longnames.size()) {
+				err << name << ": bad long member name " << n << "\n";
+				return false;
+			}
+			m.name = longnames.substr(i, longnames.find('\n', i) - i);
+		} else if (!n.compare(0, 3, "#1/")) {
+			// BSD long name: stored at the start of the member data
+			size_t len = strtoul(n.c_str() + 3, nullptr, 10);
+			if (len > msize) {
+				err << name << ": bad long member name " << n << "\n";
+				return false;
+			}
+			m.name.resize(len);
+			if (len && pread(fd, &m.name[0], len, mdata) != (ssize_t) len) {
+				err << name << " read failed: " << strerror(errno) << "\n";
+				return false;
+			}
+			m.name.erase(std::min(m.name.size(), strlen(m.name.c_str())));
+			m.offset += len;
+			m.size   -= len;
+		} else
+			m.name = n;
+
+		// GNU names end with '/'
+		if (!m.name.empty() && m.name.back() == '/')
+			m.name.pop_back();
+
+		char magic[SELFMAG];
+		m.elf = m.size >= sizeof(Elf64_Ehdr) && pread(fd, magic, SELFMAG, m.offset) == SELFMAG && !memcmp(magic, ELFMAG, SELFMAG);
+
+		out.push_back(m);
+	}
+	return true;
+}
+
+bool elf_file::store(elf_stats& stats, std::ostream& err)
+{
+	elf_stats::scope write_phase(stats, elf_stats::WRITE);
+	for (unsigned int i = 0; i < strsect.size(); i++) {
+		if (pwrite(fd, data[i].data(), data[i].size(), strsect[i].section_offset) != (ssize_t) data[i].size()) {
+			err << name << " write failed: " << strerror(errno) << "\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+void elf_file::close()
+{
+	if (fd >= 0)
+		::close(fd);
+	fd = -1;
+}
+
+// ---- Batch I/O
+
+namespace {
+
+// File being processed by the batch
+struct batch_file {
+	enum state {
+		OPEN,     // opening
+		EHDR,     // reading ELF header
+		SHDRS,    // reading section headers
+		SHSTRTAB, // reading section names
+		RANGE,    // reading .sshash.range
+		DATA,     // reading sshash sections
+		READY,    // loaded, waiting to be processed
+		WRITE,    // writing sshash sections back
+		CLOSE,    // closing
+		DONE
+	};
+
+	elf_file  f;
+	state     st;
+	unsigned  pending; // operations in flight
+	bool      failed;
+	bool      reported;
+	std::string error;
+
+	Elf64_Ehdr        ehdr;
+	std::vector<char> shdrs;
+	std::vector<char> shstrtab;
+	uint64_t          range[2];
+
+	batch_file() : st(OPEN), pending(0), failed(false), reported(false) { memset(&ehdr, 0, sizeof(ehdr)); }
+
+	void fail(const std::string& err)
+	{
+		if (!failed)
+			error = err;
+		failed = true;
+	}
+};
+
+// I/O request
+struct batch_req {
+	enum kind { OPEN, READ, WRITE, CLOSE };
+
+	batch_file *file;
+	kind        op;
+	char       *buf;
+	size_t      len;
+	uint64_t    off;
+};
+
+} // namespace
+
+struct elf_batch::impl {
+	uring    ring;
+	unsigned depth;
+	unsigned window;
+
+	std::deque<batch_req*> backlog; // requests that did not fit into the ring
+
+	void issue(batch_file *b, batch_req::kind op, char *buf = nullptr, size_t len = 0, uint64_t off = 0)
+	{
+		b->pending++;
+		backlog.push_back(new batch_req{b, op, buf, len, off});
+	}
+
+	// Move requests from the backlog into the ring
+	void queue()
+	{
+		while (!backlog.empty() && ring.space()) {
+			batch_req *r = backlog.front();
+			uint64_t ud = (uint64_t) (uintptr_t) r;
+			const unsigned int max_io = 1u << 30;
+			unsigned int len = r->len > max_io ? max_io : r->len;
+
+			switch (r->op) {
+			case batch_req::OPEN:  ring.openat(AT_FDCWD, r->file->f.name.c_str(), O_RDWR, ud); break;
+			case batch_req::READ:  ring.read(r->file->f.fd, r->buf, len, r->off, ud); break;
+			case batch_req::WRITE: ring.write(r->file->f.fd, r->buf, len, r->off, ud); break;
+			case batch_req::CLOSE: ring.close(r->file->f.fd, ud); break;
+			}
+			backlog.pop_front();
+		}
+	}
+
+	void start_close(batch_file *b)
+	{
+		if (b->f.fd < 0) {
+			b->st = batch_file::DONE;
+			return;
+		}
+		b->st = batch_file::CLOSE;
+		issue(b, batch_req::CLOSE);
+	}
+
+	// Read the sshash sections
+	void start_data(batch_file *b);
+
+	// All reads of the current state are done, move on to the next one
+	void advance(batch_file *b);
+
+	void complete(batch_req *r, int res);
+};
+
+void elf_batch::impl::start_data(batch_file *b)
+{
+	elf_file &f = b->f;
+
+	b->st = batch_file::DATA;
+	for (unsigned int i = 0; i < f.strsect.size(); i++) {
+		f.data[i].resize(f.strsect[i].section_size);
+		if (!f.data[i].empty())
+			issue(b, batch_req::READ, f.data[i].data(), f.data[i].size(), f.strsect[i].section_offset);
+	}
+	if (f.has_meta) {
+		f.meta_data.resize(f.meta.section_size);
+		if (!f.meta_data.empty())
+			issue(b, batch_req::READ, f.meta_data.data(), f.meta_data.size(), f.meta.section_offset);
+	}
+	if (!b->pending)
+		b->st = batch_file::READY;
+}
+
+void elf_batch::impl::advance(batch_file *b)
+{
+	elf_file &f = b->f;
+
+	switch (b->st) {
+	case batch_file::OPEN:
+		b->st = batch_file::EHDR;
+		issue(b, batch_req::READ, (char *) &b->ehdr, sizeof(b->ehdr), 0);
+		break;
+
+	case batch_file::EHDR: {
+		const Elf64_Ehdr &eh = b->ehdr;
+		if (!memcmp(&eh, ARMAG, SARMAG)) {
+			// Archive members are processed by the callback
+			f.archive = true;
+			b->st = batch_file::READY;
+			break;
+		}
+		if (!memcmp(&eh, "!<thin>\n", SARMAG)) {
+			b->fail(": thin archives are not supported, process the member objects instead");
+			break;
+		}
+		const char *e = elf_file::check_header(eh);
+		if (e) {
+			b->fail(std::string(": readelf failed: ") + e);
+			break;
+		}
+		b->st = batch_file::SHDRS;
+		b->shdrs.resize(eh.e_shnum * sizeof(Elf64_Shdr));
+		issue(b, batch_req::READ, b->shdrs.data(), b->shdrs.size(), eh.e_shoff);
+		break;
+	}
+
+	case batch_file::SHDRS: {
+		const Elf64_Shdr &sh = ((const Elf64_Shdr *) b->shdrs.data())[b->ehdr.e_shstrndx];
+		b->st = batch_file::SHSTRTAB;
+		b->shstrtab.resize(sh.sh_size + 1, 0);
+		issue(b, batch_req::READ, b->shstrtab.data(), sh.sh_size, sh.sh_offset);
+		break;
+	}
+
+	case batch_file::SHSTRTAB: {
+		f.add_sections(b->ehdr, (const Elf64_Shdr *) b->shdrs.data(), b->shstrtab, 0);
+		b->shdrs.clear();
+		b->shstrtab.clear();
+
+		if (f.has_range) {
+			if (f.range.section_size != sizeof(b->range)) {
+				b->fail(": readelf failed: invalid .sshash.range");
+				break;
+			}
+			b->st = batch_file::RANGE;
+			issue(b, batch_req::READ, (char *) b->range, sizeof(b->range), f.range.section_offset);
+			break;
+		}
+		start_data(b);
+		break;
+	}
+
+	case batch_file::RANGE: {
+		const char *e = f.add_range(b->range);
+		if (e) {
+			b->fail(std::string(": readelf failed: ") + e);
+			break;
+		}
+		start_data(b);
+		break;
+	}
+
+	case batch_file::DATA:
+		b->st = batch_file::READY;
+		break;
+
+	case batch_file::WRITE:
+		start_close(b);
+		break;
+
+	case batch_file::CLOSE:
+		b->st = batch_file::DONE;
+		break;
+
+	default:
+		break;
+	}
+}
+
+void elf_batch::impl::complete(batch_req *r, int res)
+{
+	std::unique_ptr<batch_req> req(r);
+	batch_file *b = r->file;
+	b->pending--;
+
+	switch (r->op) {
+	case batch_req::OPEN:
+		if (res < 0)
+			b->fail(std::string(" open failed: ") + strerror(-res));
+		else
+			b->f.fd = res;
+		break;
+
+	case batch_req::READ:
+	case batch_req::WRITE:
+		if (res < 0) {
+			b->fail(std::string(r->op == batch_req::READ ? " read failed: " : " write failed: ") + strerror(-res));
+			break;
+		}
+		if (!res) {
+			// Files shorter than an ELF header may still be archives
+			if (b->st == batch_file::EHDR && r->buf - (char *) &b->ehdr >= SARMAG)
+				break;
+			b->fail(r->op == batch_req::READ ? " read failed: unexpected end of file" : " write failed: no progress");
+			break;
+		}
+		if ((size_t) res < r->len) {
+			// Short read or write, continue where it stopped
+			issue(b, r->op, r->buf + res, r->len - res, r->off + res);
+			return;
+		}
+		break;
+
+	case batch_req::CLOSE:
+		if (res < 0)
+			b->fail(std::string(" close failed: ") + strerror(-res));
+		b->f.fd = -1;
+		break;
+	}
+
+	if (b->pending)
+		return;
+
+	if (!b->failed) {
+		advance(b);
+		if (!b->failed || b->pending)
+			return;
+	}
+
+	// Failed files wait for processing (in input order), which reports
+	// the error and closes them
+	switch (b->st) {
+	case batch_file::WRITE: start_close(b); break;
+	case batch_file::CLOSE: b->st = batch_file::DONE; break;
+	case batch_file::DONE:  break;
+	default: b->st = batch_file::READY; break;
+	}
+}
+
+elf_batch::elf_batch(unsigned int depth, unsigned int window) : _impl(new impl)
+{
+	_impl->depth  = depth;
+	_impl->window = window ? window : 1;
+}
+
+elf_batch::~elf_batch()
+{
+	for (auto *r : _impl->backlog)
+		delete r;
+	delete _impl;
+}
+
+bool elf_batch::init()
+{
+	return _impl->ring.init(_impl->depth);
+}
+
+bool elf_batch::run(const std::vector<std::string>& input, process_fn process, bool write, elf_stats& stats)
+{
+	impl &m = *_impl;
+	const size_t n = input.size();
+
+	std::vector<std::unique_ptr<batch_file> > files(n);
+	size_t next_open = 0; // next file to load
+	size_t next_proc = 0; // next file to process
+	size_t next_done = 0; // first file that is not released yet
+	bool   stop = false;
+	bool   ok   = true;
+
+	uring::completion cq[64];
+
+	for (;;) {
+		// Load files ahead of processing (bounded by the number of files in memory)
+		while (!stop && next_open < n && next_open - next_done < m.window) {
+			batch_file *b = new batch_file;
+			b->f.name = input[next_open];
+			files[next_open++].reset(b);
+			m.issue(b, batch_req::OPEN);
+		}
+
+		// Process loaded files in input order
+		bool progress = false;
+		while (next_proc < next_open) {
+			batch_file *b = files[next_proc].get();
+			if (b->st != batch_file::READY || b->pending)
+				break;
+
+			if (b->failed) {
+				if (!stop)
+					std::cerr << b->f.name << b->error << "\n";
+				b->reported = true;
+				ok = false;
+				stop = true;
+			} else if (!stop && !process(b->f)) {
+				ok = false;
+				stop = true;
+			}
+
+			if (!stop && write && !b->f.strsect.empty()) {
+				b->st = batch_file::WRITE;
+				for (unsigned int i = 0; i < b->f.strsect.size(); i++) {
+					std::vector<char> &d = b->f.data[i];
+					if (!d.empty())
+						m.issue(b, batch_req::WRITE, d.data(), d.size(), b->f.strsect[i].section_offset);
+				}
+				if (!b->pending)
+					m.start_close(b);
+			} else
+				m.start_close(b);
+
+			next_proc++;
+			progress = true;
+		}
+
+		// Release closed files, report write and close errors
+		for (size_t i = next_done; i < next_proc; i++) {
+			batch_file *b = files[i].get();
+			if (!b || b->st != batch_file::DONE)
+				continue;
+			if (b->failed && !b->reported) {
+				std::cerr << b->f.name << b->error << "\n";
+				ok = false;
+				stop = true;
+			}
+			files[i].reset();
+		}
+		while (next_done < next_proc && !files[next_done])
+			next_done++;
+
+		m.queue();
+
+		bool busy = m.ring.inflight() || m.ring.space() < m.ring.entries() || !m.backlog.empty();
+		if (!busy && next_proc == next_open && (stop || next_open == n))
+			break;
+
+		bool wait = !progress && busy;
+		elf_stats::scope io_phase(stats, elf_stats::IO_WAIT);
+		int r = m.ring.submit(cq, 64, wait);
+		io_phase.end();
+		if (r < 0) {
+			// Requests in flight still reference the buffers, there is no safe way out
+			std::cerr << "io_uring failed: " << strerror(-r) << "\n";
+			abort();
+		}
+		for (int i = 0; i < r; i++)
+			m.complete((batch_req *) (uintptr_t) cq[i].user_data, cq[i].res);
+	}
+
+	return ok;
+}
+
+} // namespace sshash
@@ -0,0 +1,202 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef SSHASH_ELF_IO
+#define SSHASH_ELF_IO
+
+#include <stdint.h>
+#include <elf.h>
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <iostream>
+
+#include "elf-parser.hpp"
+#include "elf-stats.hpp"
+
+namespace sshash {
+
+// Member of an ar archive
+struct ar_member {
+	std::string name;
+	uint64_t    offset; // file offset of the member data
+	uint64_t    size;
+	bool        elf;    // member is an ELF object
+};
+
+/**
+ * List the members of an ar archive (GNU and BSD name formats).
+ * The symbol and long name tables are not listed.
+ * @param fd archive file
+ * @param name archive name (for error messages)
+ * @param out members
+ * @param err error messages
+ * @return false if the archive is malformed
+ */
+bool ar_members(int fd, const std::string& name, std::vector<ar_member>& out, std::ostream& err = std::cerr);
+
+// ELF file with its sshash sections loaded into memory.
+// The .sshash.str sections are processed in memory and written back as a whole.
+// Section offsets are file offsets (archive members are processed in place).
+// ELF files linked with the strings merged into .rodata (SSHASH_STR_PLACEMENT=rodata-merge)
+// have no .sshash.str section, the part of .rodata given by .sshash.range is used instead.
+class elf_file {
+public:
+	std::string name;
+	std::vector<elf_parser::section_t> strsect; // .sshash.str sections
+	std::vector<std::vector<char> >    data;    // content of strsect[i]
+	bool                               has_meta;
+	elf_parser::section_t              meta;    // .sshash.meta (if has_meta)
+	std::vector<char>                  meta_data;
+	bool                               has_range;
+	elf_parser::section_t              range;   // .sshash.range (if has_range)
+	bool                               relocatable; // object file (not linked yet)
+	bool                               archive;     // ar archive, members are loaded separately
+	int                                fd;
+
+	elf_file() : has_meta(false), has_range(false), relocatable(false), archive(false), fd(-1), _image(nullptr), _image_size(0) {}
+	~elf_file() { close(); }
+
+	/**
+	 * Open the file and read the sshash sections (blocking I/O).
+	 * Archives are only opened (see load_member()).
+	 * @param n file name
+	 * @param stats stats to account the I/O to
+	 * @param err error messages
+	 * @return false on failure
+	 */
+	bool load(const std::string& n, elf_stats& stats, std::ostream& err = std::cerr);
+
+	/**
+	 * Read the sshash sections of an archive member (blocking I/O)
+	 * @param archive archive (opened with load())
+	 * @param m member
+	 * @param stats stats to account the I/O to
+	 * @param err error messages
+	 * @return false on failure
+	 */
+	bool load_member(const elf_file& archive, const ar_member& m, elf_stats& stats, std::ostream& err = std::cerr);
+
+	/**
+	 * Read the sshash sections of an ELF image in memory (archives are not supported)
+	 * @param n name of the image (for messages and the map)
+	 * @param image ELF image
+	 * @param size image size
+	 * @param stats stats to account the parsing to
+	 * @param err error messages
+	 * @return false on failure
+	 */
+	bool load_image(const std::string& n, const char *image, size_t size, elf_stats& stats, std::ostream& err = std::cerr);
+
+	// Copy the .sshash.str sections back into the image (see load_image())
+	void store_image(char *image) const;
+
+	/**
+	 * Write the .sshash.str sections back (blocking I/O)
+	 * @param stats stats to account the I/O to
+	 * @param err error messages
+	 * @return false on failure
+	 */
+	bool store(elf_stats& stats, std::ostream& err = std::cerr);
+
+	void close();
+
+	// Add a section found in the section headers
+	void add_section(const elf_parser::section_t& s);
+
+	/**
+	 * Add the sshash sections from the section headers
+	 * @param eh ELF header
+	 * @param sh section headers
+	 * @param shstrtab section names (NUL terminated)
+	 * @param base file offset of the ELF image
+	 */
+	void add_sections(const Elf64_Ehdr& eh, const Elf64_Shdr *sh, const std::vector<char>& shstrtab, uint64_t base);
+
+	/**
+	 * Add the strings given by the content of .sshash.range as a .sshash.str section
+	 * (only if there are no .sshash.str sections)
+	 * @param range .sshash.range content: start and end address of the strings
+	 * @return error message or nullptr
+	 */
+	const char* add_range(const uint64_t range[2]);
+
+	// Check the ELF header, returns the error message or nullptr
+	static const char* check_header(const Elf64_Ehdr& eh);
+
+private:
+	std::vector<elf_parser::section_t> _alloc; // allocated sections (for add_range())
+
+	bool read_at(void *buf, size_t len, uint64_t off, std::ostream& err);
+	bool parse(uint64_t base, std::ostream& err);
+	bool read_sections(elf_stats& stats, std::ostream& err);
+
+	const char *_image; // in-memory image (load_image()), read instead of fd
+	size_t      _image_size;
+};
+
+// Batch processing of many ELF files with io_uring.
+// Header reads, section reads, writes and closes of up to 'window' files are in
+// flight at the same time, and overlap with processing of the files that are
+// already loaded. Files are processed in input order, on the calling thread.
+class elf_batch {
+public:
+	// Processing callback, returns false to stop
+	typedef std::function<bool (elf_file&)> process_fn;
+
+	/**
+	 * @param depth io_uring submission queue size
+	 * @param window max number of files loaded ahead of processing
+	 */
+	elf_batch(unsigned int depth = 256, unsigned int window = 64);
+	~elf_batch();
+
+	// Returns false if io_uring is not available
+	bool init();
+
+	/**
+	 * Process input files
+	 * @param input file names
+	 * @param process processing callback
+	 * @param write write modified .sshash.str sections back
+	 * @param stats stats to account the I/O to
+	 * @return false if a file failed to load or to process
+	 */
+	bool run(const std::vector<std::string>& input, process_fn process, bool write, elf_stats& stats);
+
+private:
+	struct impl;
+	impl *_impl;
+};
+
+} // namespace sshash
+
+#endif // SSHASH_ELF_IO
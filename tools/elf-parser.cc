@@ -52,6 +52,7 @@
 
 #include <errno.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "elf-parser.hpp"
 using namespace elf_parser;
@@ -228,17 +229,31 @@ void Elf_parser::load_memory_map()
     if (fstat(fd, &st) < 0) {
        	_last_error = _last_error + "stat failed: " + strerror(errno);
 	_failed = true;
+	close(fd);
+	return;
     }
 
     m_mmap_program = static_cast<uint8_t*>(mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0));
     if (m_mmap_program == MAP_FAILED) {
        	_last_error = _last_error + "mmap failed: " + strerror(errno);
 	_failed = true;
+	m_mmap_program = nullptr;
+	close(fd);
+	return;
     }
+    m_mmap_size = st.st_size;
 
+    // The mapping stays valid without the descriptor
+    close(fd);
     _failed = false;
 }
 
+Elf_parser::~Elf_parser()
+{
+    if (m_mmap_program)
+        munmap(m_mmap_program, m_mmap_size);
+}
+
 std::string Elf_parser::get_section_type(int tt) {
     if(tt < 0)
         return "UNKNOWN";
@@ -98,10 +98,13 @@ class Elf_parser {
     public:
         Elf_parser (const std::string &program_path): 
 		m_program_path{program_path},
+		m_mmap_program(nullptr),
+		m_mmap_size(0),
 		_failed(false)
 	{   
             load_memory_map();
         }
+        ~Elf_parser();
         std::vector<section_t> get_sections();
         std::vector<segment_t> get_segments();
         std::vector<symbol_t> get_symbols();
@@ -131,6 +134,7 @@ class Elf_parser {
 
         std::string m_program_path;
         uint8_t *m_mmap_program;
+        size_t m_mmap_size;
 
 	std::string _last_error;
 	bool _failed;
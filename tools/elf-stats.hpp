@@ -0,0 +1,254 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef SSHASH_ELF_STATS
+#define SSHASH_ELF_STATS
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include <string>
+#include <ostream>
+
+namespace sshash {
+
+// Per-phase timing and resource statistics of ELF processing.
+// Phases are timed with wall and process CPU clocks (CPU time includes worker threads).
+// Read/write syscall counts come from /proc/self/io and cover everything the
+// process does during a phase, including map and ELF header I/O.
+class elf_stats {
+private:
+	struct snapshot {
+		uint64_t wall_ns;
+		uint64_t cpu_ns;
+		uint64_t syscr;
+		uint64_t syscw;
+		uint64_t samples; // number of samples taken before this one
+	};
+
+	struct phase {
+		uint64_t count;
+		uint64_t wall_ns;
+		uint64_t cpu_ns;
+		uint64_t syscr;
+		uint64_t syscw;
+
+		phase() : count(0), wall_ns(0), cpu_ns(0), syscr(0), syscw(0) {}
+	};
+
+public:
+	enum phase_id {
+		MAP_LOAD,
+		ELF_PARSE,
+		READ,
+		SCAN,
+		HASH,
+		MAP_UPDATE,
+		WRITE,
+		IO_WAIT,
+		MAP_SAVE,
+		VERIFY,
+		NUM_PHASES
+	};
+
+	// Counters
+	uint64_t files;
+	uint64_t sections;
+	uint64_t bytes_scanned;
+	uint64_t strings_hashed;
+	uint64_t map_new;
+	uint64_t map_existing;
+
+	elf_stats() : files(0), sections(0), bytes_scanned(0), strings_hashed(0), map_new(0), map_existing(0), _enabled(false)
+	{}
+
+	// Start collecting (before the first phase)
+	void enable()
+	{
+		_enabled = true;
+		_start = sample();
+	}
+
+	bool enabled() const { return _enabled; }
+
+	// Timer for the duration of a phase (or until end() is called)
+	class scope {
+	public:
+		scope(elf_stats& s, phase_id id) : _stats(s), _id(id), _active(s._enabled)
+		{
+			if (_active)
+				_start = sample();
+		}
+
+		~scope() { end(); }
+
+		void end()
+		{
+			if (_active)
+				_stats.add(_id, _start, sample());
+			_active = false;
+		}
+
+	private:
+		elf_stats& _stats;
+		phase_id   _id;
+		bool       _active;
+		snapshot   _start;
+	};
+
+	/**
+	 * Write stats as JSON
+	 * @param os output stream
+	 * @param map_entries number of entries in the map
+	 */
+	void dump_json(std::ostream& os, uint64_t map_entries) const
+	{
+		snapshot end = sample();
+
+		struct rusage ru;
+		getrusage(RUSAGE_SELF, &ru);
+
+		os << "{\n"
+			<< "  \"files\": " << files << ",\n"
+			<< "  \"sections\": " << sections << ",\n"
+			<< "  \"bytes_scanned\": " << bytes_scanned << ",\n"
+			<< "  \"strings_hashed\": " << strings_hashed << ",\n"
+			<< "  \"map_new\": " << map_new << ",\n"
+			<< "  \"map_existing\": " << map_existing << ",\n"
+			<< "  \"map_entries\": " << map_entries << ",\n"
+			<< "  \"wall_ms\": " << ms(end.wall_ns - _start.wall_ns) << ",\n"
+			<< "  \"cpu_ms\": " << ms(end.cpu_ns - _start.cpu_ns) << ",\n"
+			<< "  \"syscalls_read\": " << reads(_start, end) << ",\n"
+			<< "  \"syscalls_write\": " << end.syscw - _start.syscw << ",\n"
+			<< "  \"ctx_switches\": " << ru.ru_nvcsw + ru.ru_nivcsw << ",\n"
+			<< "  \"peak_rss_kb\": " << ru.ru_maxrss << ",\n"
+			<< "  \"phases\": {";
+
+		bool first = true;
+		for (unsigned int i = 0; i < NUM_PHASES; i++) {
+			const phase &p = _phases[i];
+			if (!p.count)
+				continue;
+			os << (first ? "\n" : ",\n") << "    \"" << phase_name(i) << "\": {"
+				<< " \"count\": " << p.count
+				<< ", \"wall_ms\": " << ms(p.wall_ns)
+				<< ", \"cpu_ms\": " << ms(p.cpu_ns)
+				<< ", \"syscalls_read\": " << p.syscr
+				<< ", \"syscalls_write\": " << p.syscw << " }";
+			first = false;
+		}
+		os << (first ? "}\n" : "\n  }\n") << "}\n";
+	}
+
+	static const char* phase_name(unsigned int i)
+	{
+		static const char *names[NUM_PHASES] = {
+			"map_load", "elf_parse", "read", "scan", "hash", "map_update", "write", "io_wait", "map_save", "verify"
+		};
+		return i < NUM_PHASES ? names[i] : "unknown";
+	}
+
+private:
+	static uint64_t clock_ns(clockid_t id)
+	{
+		struct timespec ts;
+		clock_gettime(id, &ts);
+		return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+	}
+
+	static snapshot sample()
+	{
+		snapshot s;
+		s.wall_ns = clock_ns(CLOCK_MONOTONIC);
+		s.cpu_ns  = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+		s.syscr = s.syscw = 0;
+
+		// Not available on all kernels (CONFIG_TASK_IO_ACCOUNTING).
+		// Each sample costs one read syscall, which is subtracted from the counts.
+		static uint64_t samples = 0;
+		s.samples = samples++;
+
+		int fd = open("/proc/self/io", O_RDONLY);
+		if (fd >= 0) {
+			char buf[512];
+			ssize_t n = read(fd, buf, sizeof(buf) - 1);
+			close(fd);
+
+			buf[n > 0 ? n : 0] = 0;
+			const char *r = strstr(buf, "syscr:");
+			const char *w = strstr(buf, "syscw:");
+			if (r)
+				s.syscr = strtoull(r + 6, NULL, 10);
+			if (w)
+				s.syscw = strtoull(w + 6, NULL, 10);
+		}
+		return s;
+	}
+
+	// Milliseconds with microsecond resolution
+	static std::string ms(uint64_t ns)
+	{
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%.3f", ns / 1e6);
+		return buf;
+	}
+
+	// Read syscalls between two samples, not counting the samples themselves
+	static uint64_t reads(const snapshot& b, const snapshot& e)
+	{
+		uint64_t n = e.syscr - b.syscr;
+		uint64_t self = e.samples - b.samples;
+		return n > self ? n - self : 0;
+	}
+
+	void add(phase_id id, const snapshot& b, const snapshot& e)
+	{
+		phase &p = _phases[id];
+		p.count++;
+		p.wall_ns += e.wall_ns - b.wall_ns;
+		p.cpu_ns  += e.cpu_ns - b.cpu_ns;
+		p.syscr   += reads(b, e);
+		p.syscw   += e.syscw - b.syscw;
+	}
+
+	bool     _enabled;
+	snapshot _start;
+	phase    _phases[NUM_PHASES];
+};
+
+} // namespace sshash
+
+#endif // SSHASH_ELF_STATS
@@ -37,10 +37,19 @@
 #include <iostream>
 #include <vector>
 #include <exception>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 #include "sshash/map.hpp"
 #include "elf-parser.hpp"
+#include "sshash/scanner.hpp"
 #include "sha.hpp"
+#include "elf-stats.hpp"
+#include "elf-io.hpp"
+#include "elf-hash.hpp"
+#include "daemon.hpp"
 
 #include <boost/program_options.hpp>
 
@@ -49,158 +58,335 @@ static po::variables_map optmap;
 
 static bool opt_verbose = false;
 static bool opt_dryrun  = false;
+static bool opt_ids     = false;
+static bool opt_fragment = false;
+static unsigned int opt_jobs = 1;
+static sshash::elf_stats stats;
+
+// Hash a loaded input (ELF file or archive) and write its map fragment.
+// Archive members are written back here, ELF files by the caller.
+static bool elf_hash_input(sshash::elf_hash_engine& hasher, sshash::elf_file& f)
+{
+	// Start from the fragment of an earlier run, so that hashing again is a no-op
+	sshash::map frag;
+	if (opt_fragment) {
+		if (!frag.load(f.name + ".sshash-map", true))
+			return false;
+		hasher.set_fragment(&frag);
+	}
 
-// Parse sshash padded strings from an ELF sections
-class string_parser {
-public:
-	string_parser(int fd, unsigned int sect_offset, unsigned int sect_size)
-		: _fd(fd), _start(sect_offset), _size(sect_size)
-	{
-		_end = _start + _size;
-		_offset = _start;
+	bool ok = f.archive ? hasher.hash_archive(f, !opt_dryrun, std::cout, std::cerr) :
+		hasher.hash(f, std::cout, std::cerr);
+	hasher.set_fragment(nullptr);
+
+	if (ok && opt_fragment && !frag.save(f.name + ".sshash-map"))
+		ok = false;
+	return ok;
+}
+
+// Process one file with blocking I/O
+static bool elf_process(sshash::elf_hash_engine& hasher, const std::string& infile)
+{
+	sshash::elf_file f;
+	if (!f.load(infile, stats))
+		return false;
+
+	if (!elf_hash_input(hasher, f))
+		return false;
+
+	if (!opt_dryrun && !f.store(stats))
+		return false;
+
+	return true;
+}
+
+// Merge map fragments into the map
+static bool elf_merge(sshash::elf_hash_engine& hasher, const sshash::sha& sha, const std::vector<std::string>& input)
+{
+	for (auto &i : input) {
+		sshash::map frag;
+		if (!frag.load(i))
+			return false;
+
+		std::cout << "merging " << i << ": " << frag.size() << " strings\n";
+		for (auto &e : frag) {
+			if (e.first.size() != sha.size()) {
+				std::cerr << i << ": digest " << e.first << " does not match --minlen " << sha.size() << "\n";
+				return false;
+			}
+			std::string str = e.second.get<std::string>("str", std::string());
+			std::string elf = e.second.get<std::string>("elf", std::string());
+			if (!hasher.add(elf, e.first, str, std::cerr))
+				return false;
+		}
 	}
+	return true;
+}
 
-	// Get the next string
-	// Returns content, offset and room till next string
-	bool next(std::string& str, uint64_t& offset, size_t& room)
-	{
-		offset = _offset; // current offset
-		_str.clear();
-
-		try {
-			do_read(true,  false); // main string
-			do_read(false, true);  // zeros
-			do_read(false, false); // sshash pad
-			do_read(false, true);  // zeros
-		} catch (std::exception& e) {
-			std::cerr << "failed to read next string: " << e.what() << '\n';
+// Hand the files to sshash-daemon, which hashes them with its resident map
+static bool elf_submit(const std::string& socket, const std::vector<std::string>& input)
+{
+	sshash::daemon_client daemon;
+	if (!daemon.connect(socket))
+		return false;
+
+	for (auto &infile : input) {
+		// The daemon may run in a different directory
+		char *path = realpath(infile.c_str(), nullptr);
+		if (!path) {
+			std::cerr << infile << ": " << strerror(errno) << "\n";
 			return false;
 		}
 
-		room = _offset - offset;
-		str  = _str;
-		return !str.empty();
+		std::string req = "elf ";
+		if (opt_dryrun)
+			req += "dryrun ";
+		if (opt_ids)
+			req += "ids ";
+		req += sshash::daemon_escape(path);
+		free(path);
+
+		std::cout << "processing " << infile << "\n";
+
+		std::string reply;
+		if (!daemon.request(req, reply))
+			return false;
+		if (reply.compare(0, 3, "ok ")) {
+			std::cerr << sshash::daemon_unescape(reply.compare(0, 4, "err ") ? reply : reply.substr(4)) << "\n";
+			return false;
+		}
+		if (opt_verbose)
+			std::cout << "strings (total new): " << reply.substr(3) << "\n";
 	}
+	return true;
+}
 
-private:
+// Section of a file (used for reporting leaks)
+struct file_section {
+	uint64_t    offset;
+	uint64_t    size;
+	std::string name;
+};
 
-	void do_read(bool append, bool null_term)
-	{
-		// std::cout << "READ: @" << std::hex << _offset << " append " << append << " null_term " << null_term << "\n";
-		for (;_offset < _end; _offset++) {
-			char c;
-			int r = pread(_fd, &c, 1, _offset);
-			if (r != 1)
-				throw std::string("read failed: ") + strerror(errno);
+template <typename Ehdr, typename Shdr>
+static void elf_file_sections(const uint8_t *data, size_t size, std::vector<file_section>& out)
+{
+	const Ehdr *eh = (const Ehdr *) data;
+	if (size < sizeof(Ehdr) || !eh->e_shoff || eh->e_shentsize != sizeof(Shdr))
+		return;
+	if (eh->e_shoff + (uint64_t) eh->e_shnum * sizeof(Shdr) > size || eh->e_shstrndx >= eh->e_shnum)
+		return;
 
-			// std::cout << "READ: " << (isprint(c) ? c : '.') << " " << int(c) << " @" << std::hex << _offset <<"\n";
+	const Shdr *sh = (const Shdr *) (data + eh->e_shoff);
+	const Shdr &strtab = sh[eh->e_shstrndx];
 
-			if ((c == '\0') ^ null_term)
-				return;
+	for (unsigned int i = 0; i < eh->e_shnum; i++) {
+		if (sh[i].sh_type == SHT_NOBITS || !sh[i].sh_size)
+			continue;
 
-			if (append)
-				_str += c;
-		}
+		file_section fs;
+		fs.offset = sh[i].sh_offset;
+		fs.size   = sh[i].sh_size;
+
+		uint64_t n = (uint64_t) strtab.sh_offset + sh[i].sh_name;
+		if (n < size)
+			fs.name.assign((const char *) data + n, strnlen((const char *) data + n, size - n));
+
+		out.push_back(fs);
 	}
+}
 
-	int _fd;
-	uint64_t _start;
-	uint64_t _end;
-	uint64_t _size;
-	uint64_t _offset;
+// Input file mapped for verification
+struct verify_file {
+	std::string    name;
+	const uint8_t *data;
+	size_t         size;
+	std::vector<file_section> sections;
 
-	std::string _str;
+	const char* section_name(uint64_t offset) const
+	{
+		for (auto &s : sections)
+			if (offset >= s.offset && offset - s.offset < s.size)
+				return s.name.c_str();
+		return "-";
+	}
 };
 
-static bool elf_process_section(sshash::map& map, sshash::sha& sha, const std::string& infile, int fd, const elf_parser::section_t& s)
-{
-	std::cout << "processing section: " << s.section_name << "\n";
-
-	// For each string in section, generate hash, store hash to string mapping,
-	// and replace the string with hash value.
-
-	// Init string parser
-	string_parser sp(fd, s.section_offset, s.section_size);
-
-	std::string str;
-	uint64_t str_offset, str_room;
-	while (sp.next(str, str_offset, str_room)) {
-		if (opt_verbose) {
-			std::cout << "string:" 
-				<< std::hex << " offset: " << str_offset
-				<< std::dec << " room: "   << str_room
-				<< " [" << str << "]\n";
-		}
+// Chunk of a file scanned by one worker
+struct verify_chunk {
+	unsigned int file;
+	uint64_t     start;
+	uint64_t     end;
+};
 
-		if (str_room < sha.size()) {
-			std::cerr << " not enough room for digest. missing pad???\n";
-			return false;
-		}
+struct verify_hit {
+	unsigned int file;
+	uint64_t     offset;
+	unsigned int id;
 
-		// Hash the string
-		std::string hash;
-		sha.digest(hash, str);
+	bool operator<(const verify_hit& h) const
+	{
+		if (file != h.file) return file < h.file;
+		if (offset != h.offset) return offset < h.offset;
+		return id < h.id;
+	}
+};
 
-		if (opt_verbose) {
-			std::cout << "digest: " << hash << " [" << str << "]\n";
-		}
+static bool verify_map_file(verify_file& f)
+{
+	int fd = open(f.name.c_str(), O_RDONLY);
+	if (fd < 0) {
+		std::cerr << f.name << " open failed: " << strerror(errno) << "\n";
+		return false;
+	}
 
-		// Update the map
-		if (!map.update(hash, str, infile)) {
-			std::string s = map.get<std::string>(hash + ".str");
-			if (s.compare(str) != 0) {
-				std::cerr << infile << ": hash collision: " << hash << " [" << str << "] [" << s << "]\n";
-				return false;
-			}
-		}
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		std::cerr << f.name << " stat failed: " << strerror(errno) << "\n";
+		close(fd);
+		return false;
+	}
 
-		// Write replacement string
-		if (!opt_dryrun) {
-			hash.resize(str_room, 0);
-			if (pwrite(fd, hash.data(), str_room, str_offset) != (ssize_t) str_room) {
-				std::cerr << infile << " write failed: " << strerror(errno) << "\n";
-				return false;
-			}
+	f.data = nullptr;
+	f.size = st.st_size;
+	if (f.size) {
+		void *m = mmap(NULL, f.size, PROT_READ, MAP_SHARED, fd, 0);
+		if (m == MAP_FAILED) {
+			std::cerr << f.name << " mmap failed: " << strerror(errno) << "\n";
+			close(fd);
+			return false;
 		}
+		madvise(m, f.size, MADV_SEQUENTIAL);
+		f.data = (const uint8_t *) m;
+	}
+	close(fd);
+
+	if (f.size >= EI_NIDENT && !memcmp(f.data, ELFMAG, SELFMAG)) {
+		if (f.data[EI_CLASS] == ELFCLASS64)
+			elf_file_sections<Elf64_Ehdr, Elf64_Shdr>(f.data, f.size, f.sections);
+		else if (f.data[EI_CLASS] == ELFCLASS32)
+			elf_file_sections<Elf32_Ehdr, Elf32_Shdr>(f.data, f.size, f.sections);
 	}
 
 	return true;
 }
 
-
-static bool elf_process(sshash::map& map, sshash::sha& sha, const std::string& infile)
+// Scan input files for plaintext copies of the strings in the hashmap.
+// Reports every hit and returns false if any were found.
+static bool elf_verify(sshash::map& map, const std::vector<std::string>& input, unsigned int minlen)
 {
-	std::cout << "processing " << infile << "\n";
+	// Build the scanner from all map strings
+	sshash::scanner sc;
+	std::vector<std::string> digests;
+	for (auto &e : map) {
+		std::string str = e.second.get<std::string>("str", std::string());
+		if (str.size() < minlen) {
+			if (opt_verbose && !str.empty())
+				std::cout << "skipping short string: " << e.first << " [" << str << "]\n";
+			continue;
+		}
+		sc.add(str);
+		digests.push_back(e.first);
+	}
 
-	elf_parser::Elf_parser elf_parser(infile);
-	if (elf_parser.failed()) {
-		std::cerr << infile << ": readelf failed: " << elf_parser.last_error() << "\n";
+	if (!sc.compile()) {
+		std::cerr << "failed to build string scanner: too many strings\n";
 		return false;
 	}
 
-	// Open ELF file for reading and writing
-	int fd = open(infile.c_str(), O_RDWR);
-	if (fd < 0) {
-		std::cerr << infile << " open failed: " << strerror(errno) << "\n";
-		return false;
+	if (opt_verbose)
+		std::cout << "scanner: " << sc.size() << " strings " << sc.states() << " states\n";
+
+	// Map all inputs and split them into chunks
+	const uint64_t chunk_size = 16 * 1024 * 1024;
+
+	std::vector<verify_file>  files(input.size());
+	std::vector<verify_chunk> chunks;
+	bool ok = true;
+
+	for (unsigned int i = 0; i < input.size(); i++) {
+		files[i].name = input[i];
+		if (!verify_map_file(files[i])) {
+			ok = false;
+			continue;
+		}
+		std::cout << "verifying " << files[i].name << "\n";
+
+		for (uint64_t off = 0; off < files[i].size; off += chunk_size)
+			chunks.push_back(verify_chunk{i, off, std::min(off + chunk_size, (uint64_t) files[i].size)});
 	}
 
-	// Find all .sshash.str sections
-	unsigned int found = 0;
-	std::vector<elf_parser::section_t> sections = elf_parser.get_sections();
-	for (auto& s : sections) {
-		if (s.section_name.find(".sshash.str") != std::string::npos) {
-			if (!elf_process_section(map, sha, infile, fd, s))
-				return false;
-			found++;
+	// Scan chunks on all workers.
+	// Each chunk is extended by the longest string length so that matches
+	// that straddle chunk boundaries are reported by the chunk they start in.
+	std::vector<verify_hit> hits;
+	std::atomic<size_t> next(0);
+	std::mutex lock;
+
+	auto worker = [&]() {
+		std::vector<verify_hit> local;
+		for (size_t c; (c = next++) < chunks.size(); ) {
+			const verify_chunk& ch = chunks[c];
+			const verify_file&  f  = files[ch.file];
+			uint64_t end = std::min(ch.end + sc.max_length(), (uint64_t) f.size);
+
+			sc.scan(f.data + ch.start, end - ch.start, [&](unsigned int id, size_t e) {
+				uint64_t offset = ch.start + e - sc.pattern(id).size();
+				if (offset < ch.end)
+					local.push_back(verify_hit{ch.file, offset, id});
+			});
 		}
+		std::lock_guard<std::mutex> guard(lock);
+		hits.insert(hits.end(), local.begin(), local.end());
+	};
+
+	unsigned int njobs = std::max(1u, std::min<unsigned int>(opt_jobs, chunks.size()));
+	std::vector<std::thread> workers;
+	for (unsigned int i = 1; i < njobs; i++)
+		workers.push_back(std::thread(worker));
+	worker();
+	for (auto &w : workers)
+		w.join();
+
+	std::sort(hits.begin(), hits.end());
+
+	for (auto &h : hits) {
+		const verify_file& f = files[h.file];
+		std::cout << "leak: " << f.name
+			<< std::hex << " offset 0x" << h.offset << std::dec
+			<< " section " << f.section_name(h.offset)
+			<< " digest " << digests[h.id];
+		if (opt_verbose)
+			std::cout << " [" << sc.pattern(h.id) << "]";
+		std::cout << "\n";
 	}
 
-	close(fd);
+	uint64_t nbytes = 0;
+	for (auto &f : files) {
+		nbytes += f.size;
+		if (f.data)
+			munmap((void *) f.data, f.size);
+	}
+
+	std::cout << "verified " << files.size() << " files " << nbytes << " bytes: "
+		<< hits.size() << " leaks\n";
 
-	if (!found)
-		std::cout << "warn: " << infile << " : does not contain .sshash.str sections\n";
+	return ok && hits.empty();
+}
 
+static bool write_stats(const std::string& name, uint64_t map_entries)
+{
+	if (name == "-") {
+		stats.dump_json(std::cerr, map_entries);
+		return true;
+	}
+
+	std::ofstream f(name);
+	stats.dump_json(f, map_entries);
+	if (!f) {
+		std::cerr << name << " write failed\n";
+		return false;
+	}
 	return true;
 }
 
@@ -211,13 +397,24 @@ int main(int argc, char* argv[])
 	// **** Parse command line arguments ****
 	po::options_description optdesc("sshash-elf -- tool for processing sshash stings in ELF files\n"
 				"Usage: sshash-elf <--hashmap map> [options] [elf-input-files]\n"
+				"       sshash-elf --fragment [options] [elf-input-files]\n"
+				"       sshash-elf --hashmap map --merge [map-fragments]\n"
 				"Options");
 	optdesc.add_options()
 		("help", "Print this message")
-		("input",     po::value<std::vector<std::string> >(&input)->composing(), "Input ELF file. Multiple files can be specified.")
+		("input",     po::value<std::vector<std::string> >(&input)->composing(), "Input ELF file (executable, library, object or ar archive). Multiple files can be specified.")
 		("hashmap,m", po::value<std::string>(), "Output hasmap file.")
 		("minlen,L",  po::value<unsigned int>()->default_value(8), "Length of the hash value (aka min string length)")
 		("dryrun",    "Generate hashmap file but do not modify input files")
+		("ids",       "Write the string ID table (<input>.sshash-ids) for each input")
+		("fragment",  "Write the strings of each input to a map fragment (<input>.sshash-map). The hashmap is optional.")
+		("merge",     "Do not hash. Merge the input map fragments into the hashmap.")
+		("verify",    "Do not hash. Scan input files for plaintext copies of the strings in the hashmap.")
+		("verify-minlen", po::value<unsigned int>()->default_value(4), "Ignore hashmap strings shorter than this in verify mode")
+		("jobs,j",    po::value<unsigned int>()->default_value(0), "Number of worker threads (0 - number of CPUs)")
+		("stats",     po::value<std::string>(), "Write timing and resource stats as JSON to this file (\"-\" for stderr)")
+		("daemon",    po::value<std::string>(), "Do not hash locally. Submit the inputs to sshash-daemon listening on this socket.")
+		("io",        po::value<std::string>()->default_value("auto"), "I/O backend: sync, uring (io_uring batch I/O) or auto (uring for multiple inputs if available)")
 		("verbose",   "Show verbose info (digest values, etc)");
 
 	po::positional_options_description popt;
@@ -237,6 +434,11 @@ int main(int argc, char* argv[])
 
 	opt_verbose = optmap.count("verbose");
 	opt_dryrun  = optmap.count("dryrun");
+	opt_ids     = optmap.count("ids");
+	opt_fragment = optmap.count("fragment");
+	opt_jobs    = optmap["jobs"].as<unsigned int>();
+	if (!opt_jobs)
+		opt_jobs = std::max(1u, std::thread::hardware_concurrency());
 
 	char usage_banner[] = "usage: sshash-tool [<elf_file>] [<ssiMapFilename>]\n";
 	if(argc < 3) {
@@ -244,23 +446,85 @@ int main(int argc, char* argv[])
 		return -1;
 	}
 
-	sshash::map map;
+	const std::string io = optmap["io"].as<std::string>();
+	if (io != "auto" && io != "sync" && io != "uring") {
+		std::cerr << "unknown I/O backend: " << io << "\n";
+		return 1;
+	}
 
-	// Load map.
-	// This may fail if the map doesn't exist yet.
-	map.load(optmap["hashmap"].as<std::string>(), true /* optional */);
+	const bool remote = optmap.count("daemon") && !optmap.count("verify");
+	if (!remote && !optmap.count("hashmap") && (!opt_fragment || optmap.count("verify") || optmap.count("merge"))) {
+		std::cerr << "hashmap is required\n";
+		return 1;
+	}
 
-	// Init hash generator
-	const unsigned int minlen = optmap["minlen"].as<unsigned int>();
-	sshash::sha sha(minlen);
+	if (optmap.count("stats"))
+		stats.enable();
 
-	// Process all inputs
-	for (auto &i : input) {
-		if (!elf_process(map, sha, i))
-			break;
+	sshash::map map;
+	bool ok = true;
+
+	if (remote) {
+		ok = elf_submit(optmap["daemon"].as<std::string>(), input);
+	} else if (optmap.count("verify")) {
+		sshash::elf_stats::scope load_phase(stats, sshash::elf_stats::MAP_LOAD);
+		if (!map.load(optmap["hashmap"].as<std::string>()))
+			return 1;
+		load_phase.end();
+
+		sshash::elf_stats::scope verify_phase(stats, sshash::elf_stats::VERIFY);
+		ok = elf_verify(map, input, optmap["verify-minlen"].as<unsigned int>());
+		verify_phase.end();
+	} else {
+		// Load map.
+		// This may fail if the map doesn't exist yet.
+		const bool use_map = optmap.count("hashmap");
+		sshash::elf_stats::scope load_phase(stats, sshash::elf_stats::MAP_LOAD);
+		if (use_map)
+			map.load(optmap["hashmap"].as<std::string>(), true /* optional */);
+		load_phase.end();
+
+		// Init hash generator
+		const unsigned int minlen = optmap["minlen"].as<unsigned int>();
+		sshash::sha sha(minlen);
+
+		sshash::elf_hash_engine hasher(map, sha, stats);
+		hasher.set_verbose(opt_verbose);
+		hasher.set_ids(opt_ids);
+		hasher.set_jobs(opt_jobs);
+
+		// Process all inputs
+		bool use_uring = !optmap.count("merge") && (io == "uring" || (io == "auto" && input.size() > 1));
+
+		sshash::elf_batch batch;
+		if (use_uring && !batch.init()) {
+			if (io == "uring")
+				std::cerr << "warn: io_uring is not available, using blocking I/O\n";
+			use_uring = false;
+		}
+
+		if (optmap.count("merge")) {
+			ok = elf_merge(hasher, sha, input);
+		} else if (use_uring) {
+			ok = batch.run(input, [&](sshash::elf_file& f) { return elf_hash_input(hasher, f); }, !opt_dryrun, stats);
+		} else {
+			for (auto &i : input) {
+				if (!elf_process(hasher, i)) {
+					ok = false;
+					break;
+				}
+			}
+		}
+
+		// Save updated map
+		sshash::elf_stats::scope save_phase(stats, sshash::elf_stats::MAP_SAVE);
+		if (use_map)
+			map.save(optmap["hashmap"].as<std::string>());
+		save_phase.end();
 	}
 
-	// Save updated map
-	map.save(optmap["hashmap"].as<std::string>());
-	return 0;
+	if (optmap.count("stats") && !write_stats(optmap["stats"].as<std::string>(), map.size()))
+		return 1;
+
+	return ok ? 0 : 1;
 }
@@ -0,0 +1,456 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <iostream>
+#include <vector>
+#include <random>
+
+#include "sha.hpp"
+#include "doc-rewriter.hpp"
+
+#ifdef SSHASH_GEN_HOGL
+#include <hogl/format-raw.hpp>
+#include <hogl/output-plainfile.hpp>
+#include <hogl/engine.hpp>
+#include <hogl/area.hpp>
+#include <hogl/mask.hpp>
+#include <hogl/post.hpp>
+#include <hogl/tls.hpp>
+#endif
+
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+static po::variables_map optmap;
+
+// Synthetic corpus generator.
+// Generates sensitive strings with a given length distribution and emits:
+//  - C++ sources that declare them with sshash_str() (to be built into large ELFs)
+//  - JSON hash map with their digests (same layout as sshash-elf output)
+//  - hashed text and hogl raw logs that reference the digests
+// Output depends only on the options and the seed. Random numbers come from
+// mt19937_64 (which is fully specified), the distributions are implemented here
+// because the std ones are not portable across standard libraries.
+
+class corpus_rng {
+public:
+	corpus_rng(uint64_t seed) : _rng(seed) {}
+
+	uint64_t next() { return _rng(); }
+
+	// Uniform integer in [lo, hi]
+	uint64_t uniform(uint64_t lo, uint64_t hi) { return lo + _rng() % (hi - lo + 1); }
+
+	// Uniform real in [0, 1)
+	double unit() { return (_rng() >> 11) * (1.0 / 9007199254740992.0); }
+
+	// Standard normal (Box-Muller)
+	double normal()
+	{
+		double u = 1.0 - unit();
+		double v = unit();
+		return sqrt(-2.0 * log(u)) * cos(2 * M_PI * v);
+	}
+
+private:
+	std::mt19937_64 _rng;
+};
+
+// String length distribution
+struct length_dist {
+	bool     lognormal;
+	unsigned min_len;
+	unsigned max_len;
+	double   mu;
+	double   sigma;
+
+	unsigned int operator()(corpus_rng& rng) const
+	{
+		if (!lognormal)
+			return rng.uniform(min_len, max_len);
+		double l = exp(mu + sigma * rng.normal());
+		if (l < min_len)
+			return min_len;
+		if (l > max_len)
+			return max_len;
+		return (unsigned int) l;
+	}
+};
+
+// Set of 64-bit digest fingerprints (open addressing, 0 is the empty slot).
+// Used to avoid digest collisions without keeping all strings around.
+class fingerprint_set {
+public:
+	fingerprint_set(size_t n)
+	{
+		size_t cap = 1024;
+		while (cap < n * 2)
+			cap <<= 1;
+		_slots.resize(cap, 0);
+	}
+
+	// Returns false if the fingerprint is already in the set
+	bool insert(const std::string& s)
+	{
+		uint64_t h = 0xcbf29ce484222325ull;
+		for (unsigned char c : s)
+			h = (h ^ c) * 0x100000001b3ull;
+		h |= 1;
+
+		size_t mask = _slots.size() - 1;
+		for (size_t i = h & mask; ; i = (i + 1) & mask) {
+			if (_slots[i] == h)
+				return false;
+			if (!_slots[i]) {
+				_slots[i] = h;
+				return true;
+			}
+		}
+	}
+
+private:
+	std::vector<uint64_t> _slots;
+};
+
+// Characters used in the generated strings.
+// No quotes or backslashes, so that the strings can be used as is in C, JSON and asm.
+static const char str_alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 -_.:/=,";
+
+class corpus {
+public:
+	corpus(uint64_t seed, const length_dist& dist, unsigned int digest_len, size_t n) :
+		_rng(seed), _dist(dist), _sha(digest_len), _digests(n)
+	{}
+
+	// Generate the next unique string and its digest.
+	// The string ends with the index in base 36, which keeps it unique.
+	void next(size_t index, std::string& str, std::string& digest)
+	{
+		std::string id;
+		for (size_t i = index; ; i /= 36) {
+			id.insert(id.begin(), "0123456789abcdefghijklmnopqrstuvwxyz"[i % 36]);
+			if (i < 36)
+				break;
+		}
+
+		do {
+			unsigned int len = _dist(_rng);
+			str.clear();
+			while (str.size() + id.size() + 1 < len)
+				str += str_alphabet[_rng.next() % (sizeof(str_alphabet) - 1)];
+			str += ' ';
+			str += id;
+			_sha.digest(digest, str);
+		} while (!_digests.insert(digest));
+	}
+
+	corpus_rng& rng() { return _rng; }
+
+private:
+	corpus_rng      _rng;
+	length_dist     _dist;
+	sshash::sha     _sha;
+	fingerprint_set _digests;
+};
+
+// Streaming writer for the JSON map (same layout as boost write_json)
+class map_writer {
+public:
+	map_writer(const std::string& elf) : _elf(elf), _count(0) {}
+
+	bool open(const std::string& name)
+	{
+		if (!_out.open(name))
+			return false;
+		_out.put("{\n");
+		return true;
+	}
+
+	void add(const std::string& str, const std::string& digest)
+	{
+		if (_count++)
+			_out.put(",\n");
+		_out.put("    \"" + digest + "\": {\n");
+		_out.put("        \"str\": \"" + str + "\",\n");
+		_out.put("        \"elf\": \"" + _elf + "\"\n");
+		_out.put("    }");
+	}
+
+	bool close()
+	{
+		_out.put(_count ? "\n}\n" : "}\n");
+		return _out.close();
+	}
+
+private:
+	sshash::out_file _out;
+	std::string      _elf;
+	size_t           _count;
+};
+
+// Sources: corpus-<k>.cc with a fill function each, and corpus-main.cc
+static bool write_sources(const std::string& dir, const std::vector<std::string>& strs, unsigned int nfiles)
+{
+	size_t per_file = (strs.size() + nfiles - 1) / nfiles;
+
+	for (unsigned int k = 0; k < nfiles; k++) {
+		sshash::out_file out;
+		if (!out.open(dir + "/corpus-" + std::to_string(k) + ".cc"))
+			return false;
+
+		size_t b = std::min(strs.size(), k * per_file);
+		size_t e = std::min(strs.size(), b + per_file);
+
+		out.put("// Generated by sshash-gen\n#include \"sshash/macros.hpp\"\n\n");
+		out.put("void corpus_" + std::to_string(k) + "(const char **v)\n{\n");
+		for (size_t i = b; i < e; i++)
+			out.put("\tv[" + std::to_string(i) + "] = sshash_str(\"" + strs[i] + "\");\n");
+		out.put("}\n");
+		if (!out.close())
+			return false;
+	}
+
+	sshash::out_file out;
+	if (!out.open(dir + "/corpus-main.cc"))
+		return false;
+
+	out.put("// Generated by sshash-gen\n#include <stdio.h>\n\n");
+	for (unsigned int k = 0; k < nfiles; k++)
+		out.put("void corpus_" + std::to_string(k) + "(const char **v);\n");
+	out.put("\nstatic const char *corpus_strings[" + std::to_string(std::max<size_t>(strs.size(), 1)) + "];\n\n");
+	out.put("int main(int argc, char *argv[])\n{\n");
+	for (unsigned int k = 0; k < nfiles; k++)
+		out.put("\tcorpus_" + std::to_string(k) + "(corpus_strings);\n");
+	if (!strs.empty())
+		out.put("\tputs(corpus_strings[(unsigned int) argc % " + std::to_string(strs.size()) + "]);\n");
+	out.put("\treturn 0;\n}\n");
+	return out.close();
+}
+
+// Log record templates: format and number of string args
+static const struct {
+	const char  *fmt;
+	unsigned int nstr;
+} log_templates[] = {
+	{ "connection %u established user %s",        1 },
+	{ "session %u key %s value %s",               2 },
+	{ "request %u processed in %u usec",          0 },
+	{ "lookup %u of %s failed, retrying with %s", 2 },
+	{ "state %u for %s",                          1 },
+};
+
+enum { NUM_TEMPLATES = sizeof(log_templates) / sizeof(log_templates[0]) };
+
+// Hashed text log, similar to hogl fast1 output of a hashed binary
+static bool write_text_log(const std::string& name, corpus_rng& rng, const std::vector<std::string>& digests, uint64_t nrecords)
+{
+	sshash::out_file out;
+	if (!out.open(name))
+		return false;
+
+	char buf[64];
+	for (uint64_t i = 0; i < nrecords; i++) {
+		uint64_t ts = 1622548800000000ull + i * 137;
+		snprintf(buf, sizeof(buf), "%llu.%06llu CORPUS:INFO ",
+			(unsigned long long) ts / 1000000, (unsigned long long) ts % 1000000);
+		out.put(buf);
+
+		// Expand the template by hand, %u gets the record number
+		const auto &t = log_templates[rng.next() % NUM_TEMPLATES];
+		for (const char *p = t.fmt; *p; p++) {
+			if (p[0] == '%' && p[1] == 's') {
+				out.put(digests.empty() ? std::string("none") : digests[rng.next() % digests.size()]);
+				p++;
+			} else if (p[0] == '%' && p[1] == 'u') {
+				out.put(std::to_string(i));
+				p++;
+			} else
+				out.put(*p);
+		}
+		out.put('\n');
+	}
+	return out.close();
+}
+
+#ifdef SSHASH_GEN_HOGL
+// Hashed hogl raw log: the string arguments are the digests, like a hashed binary would log.
+// Records are posted through a blocking ring so that none are dropped.
+static bool write_raw_log(const std::string& name, corpus_rng& rng, const std::vector<std::string>& digests, uint64_t nrecords)
+{
+	if (digests.empty()) {
+		std::cerr << name << ": raw log needs strings\n";
+		return false;
+	}
+
+	hogl::format_raw fmt;
+	hogl::output_plainfile out(name.c_str(), fmt);
+	hogl::activate(out);
+
+	const hogl::area *area = hogl::add_area("CORPUS");
+	hogl::mask logmask(".*", 0);
+	hogl::apply_mask(logmask);
+
+	{
+		hogl::ringbuf::options ring_opts = { 16 * 1024, 0, hogl::ringbuf::BLOCKING, 256 };
+		hogl::tls tls("CORPUS-GEN", ring_opts);
+
+		for (uint64_t i = 0; i < nrecords; i++) {
+			const auto &t = log_templates[rng.next() % NUM_TEMPLATES];
+			const char *s0 = digests[rng.next() % digests.size()].c_str();
+			const char *s1 = digests[rng.next() % digests.size()].c_str();
+			switch (t.nstr) {
+			case 0:
+				hogl::post(area, area->INFO, hogl::arg_gstr(t.fmt), (unsigned int) i, (unsigned int) (i % 1000));
+				break;
+			case 1:
+				hogl::post(area, area->INFO, hogl::arg_gstr(t.fmt), (unsigned int) i, hogl::arg_gstr(s0));
+				break;
+			default:
+				hogl::post(area, area->INFO, hogl::arg_gstr(t.fmt), (unsigned int) i, hogl::arg_gstr(s0), hogl::arg_gstr(s1));
+				break;
+			}
+		}
+	}
+
+	hogl::deactivate();
+	return true;
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+	// **** Parse command line arguments ****
+	po::options_description optdesc("sshash-gen -- synthetic corpus generator\n"
+				"Usage: sshash-gen [options]\n"
+				"Options");
+	optdesc.add_options()
+		("help", "Print this message")
+		("seed",       po::value<uint64_t>()->default_value(1), "Random seed")
+		("strings,n",  po::value<uint64_t>()->default_value(100000), "Number of strings in the sources")
+		("map-extra",  po::value<uint64_t>()->default_value(0), "Number of map entries that are not in the sources")
+		("len-dist",   po::value<std::string>()->default_value("uniform"), "String length distribution: uniform or lognormal")
+		("min-len",    po::value<unsigned int>()->default_value(4), "Minimum string length")
+		("max-len",    po::value<unsigned int>()->default_value(64), "Maximum string length")
+		("median-len", po::value<double>()->default_value(20), "Median string length (lognormal)")
+		("len-sigma",  po::value<double>()->default_value(0.6), "Sigma of log(length) (lognormal)")
+		("minlen,L",   po::value<unsigned int>()->default_value(8), "Length of the digest (same as sshash-elf --minlen)")
+		("sources",    po::value<std::string>(), "Output directory for C++ sources")
+		("files",      po::value<unsigned int>()->default_value(16), "Number of source files")
+		("hashmap,m",  po::value<std::string>(), "Output JSON hash map")
+		("elf-name",   po::value<std::string>()->default_value("corpus-elf"), "ELF name recorded in the hash map")
+		("text-log",   po::value<std::string>(), "Output hashed text log")
+#ifdef SSHASH_GEN_HOGL
+		("raw-log",    po::value<std::string>(), "Output hashed hogl raw log")
+#endif
+		("records",    po::value<uint64_t>()->default_value(1000000), "Number of log records");
+
+	po::store(po::command_line_parser(argc, argv).options(optdesc).run(), optmap);
+	po::notify(optmap);
+
+	if (optmap.count("help")) {
+		std::cout << optdesc << std::endl;
+		return 1;
+	}
+
+	length_dist dist;
+	const std::string &d = optmap["len-dist"].as<std::string>();
+	if (d != "uniform" && d != "lognormal") {
+		std::cerr << "unsupported length distribution: " << d << "\n";
+		return 1;
+	}
+	dist.lognormal = d == "lognormal";
+	dist.min_len   = optmap["min-len"].as<unsigned int>();
+	dist.max_len   = optmap["max-len"].as<unsigned int>();
+	dist.mu        = log(std::max(1.0, optmap["median-len"].as<double>()));
+	dist.sigma     = optmap["len-sigma"].as<double>();
+	if (!dist.min_len || dist.min_len > dist.max_len) {
+		std::cerr << "invalid string length range: " << dist.min_len << " - " << dist.max_len << "\n";
+		return 1;
+	}
+
+	const uint64_t nstrs  = optmap["strings"].as<uint64_t>();
+	const uint64_t nextra = optmap["map-extra"].as<uint64_t>();
+	const unsigned int nfiles = std::max(1u, optmap["files"].as<unsigned int>());
+
+	map_writer mw(optmap["elf-name"].as<std::string>());
+	if (optmap.count("hashmap") && !mw.open(optmap["hashmap"].as<std::string>()))
+		return 1;
+
+	corpus c(optmap["seed"].as<uint64_t>(), dist, optmap["minlen"].as<unsigned int>(), nstrs + nextra);
+
+	// Source strings are kept for the sources, their digests for the logs
+	std::vector<std::string> strs, digests;
+	strs.reserve(nstrs);
+	digests.reserve(nstrs);
+
+	std::string str, digest;
+	for (uint64_t i = 0; i < nstrs + nextra; i++) {
+		c.next(i, str, digest);
+		if (optmap.count("hashmap"))
+			mw.add(str, digest);
+		if (i < nstrs) {
+			strs.push_back(str);
+			digests.push_back(digest);
+		}
+	}
+
+	if (optmap.count("hashmap") && !mw.close())
+		return 1;
+
+	if (optmap.count("sources")) {
+		const std::string &dir = optmap["sources"].as<std::string>();
+		if (mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST) {
+			std::cerr << dir << " mkdir failed: " << strerror(errno) << "\n";
+			return 1;
+		}
+		if (!write_sources(dir, strs, nfiles))
+			return 1;
+	}
+
+	const uint64_t nrecords = optmap["records"].as<uint64_t>();
+	if (optmap.count("text-log") && !write_text_log(optmap["text-log"].as<std::string>(), c.rng(), digests, nrecords))
+		return 1;
+
+#ifdef SSHASH_GEN_HOGL
+	if (optmap.count("raw-log") && !write_raw_log(optmap["raw-log"].as<std::string>(), c.rng(), digests, nrecords))
+		return 1;
+#endif
+
+	return 0;
+}
@@ -0,0 +1,135 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#include <string.h>
+
+#include <string>
+#include <sstream>
+
+#include "sshash/hasher.hpp"
+#include "sha.hpp"
+#include "elf-io.hpp"
+#include "elf-hash.hpp"
+#include "elf-stats.hpp"
+
+namespace sshash {
+
+struct elf_hasher::impl {
+	map&            _map;
+	sha             _sha;
+	elf_stats       _stats;
+	elf_hash_engine _engine;
+	bool            _dryrun;
+	std::ostream    _null;  // discards the progress messages
+	std::ostream   *_log;
+	result_fn       _result_fn;
+
+	impl(map& m, const options& o) :
+		_map(m), _sha(o.digest_len), _engine(_map, _sha, _stats),
+		_dryrun(o.dryrun), _null(nullptr), _log(o.log ? o.log : &_null)
+	{
+		_engine.set_ids(o.ids);
+		_engine.set_jobs(o.jobs);
+	}
+
+	// Hash a loaded input, and fill in the result
+	template <typename F>
+	bool run(result& r, F load_and_hash)
+	{
+		std::ostringstream err;
+		elf_stats before = _stats;
+
+		_engine.set_fragment(&r.strings);
+		r.ok = load_and_hash(err);
+		_engine.set_fragment(nullptr);
+
+		r.error        = err.str();
+		r.sections     = _stats.sections - before.sections;
+		r.hashed       = _stats.strings_hashed - before.strings_hashed;
+		r.map_new      = _stats.map_new - before.map_new;
+		r.map_existing = _stats.map_existing - before.map_existing;
+
+		if (_result_fn)
+			_result_fn(r);
+		return r.ok;
+	}
+};
+
+elf_hasher::elf_hasher(map& m, const options& o) : _impl(new impl(m, o))
+{}
+
+elf_hasher::~elf_hasher()
+{
+	delete _impl;
+}
+
+void elf_hasher::on_result(result_fn fn)
+{
+	_impl->_result_fn = fn;
+}
+
+map& elf_hasher::get_map()
+{
+	return _impl->_map;
+}
+
+bool elf_hasher::hash_file(const std::string& path)
+{
+	impl &i = *_impl;
+
+	result r;
+	r.name = path;
+	return i.run(r, [&](std::ostream& err) {
+		elf_file f;
+		if (!f.load(path, i._stats, err))
+			return false;
+		if (f.archive)
+			return i._engine.hash_archive(f, !i._dryrun, *i._log, err);
+		return i._engine.hash(f, *i._log, err) && (i._dryrun || f.store(i._stats, err));
+	});
+}
+
+bool elf_hasher::hash_buffer(const std::string& name, char *image, size_t size)
+{
+	impl &i = *_impl;
+
+	result r;
+	r.name = name;
+	return i.run(r, [&](std::ostream& err) {
+		elf_file f;
+		if (!f.load_image(name, image, size, i._stats, err) || !i._engine.hash(f, *i._log, err))
+			return false;
+		if (!i._dryrun)
+			f.store_image(image);
+		return true;
+	});
+}
+
+} // namespace sshash
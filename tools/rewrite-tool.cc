@@ -0,0 +1,358 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "sshash/map.hpp"
+#include "sshash/matcher.hpp"
+#include "doc-rewriter.hpp"
+
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+static po::variables_map optmap;
+
+static bool opt_verbose = false;
+static unsigned int opt_jobs = 1;
+static uint64_t opt_chunk_size = 4 * 1024 * 1024;
+static std::string opt_out_prefix;
+static std::string opt_out_suffix;
+
+// Input file mapped into memory
+struct input_file {
+	std::string name;
+	const char *data;
+	size_t      size;
+
+	input_file() : data(nullptr), size(0) {}
+	~input_file() { if (data) munmap((void *) data, size); }
+
+	bool map(const std::string& n)
+	{
+		name = n;
+		int fd = open(name.c_str(), O_RDONLY);
+		if (fd < 0) {
+			std::cerr << name << " open failed: " << strerror(errno) << "\n";
+			return false;
+		}
+
+		struct stat st;
+		if (fstat(fd, &st) < 0) {
+			std::cerr << name << " stat failed: " << strerror(errno) << "\n";
+			close(fd);
+			return false;
+		}
+
+		size = st.st_size;
+		if (size) {
+			void *m = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+			if (m == MAP_FAILED) {
+				std::cerr << name << " mmap failed: " << strerror(errno) << "\n";
+				close(fd);
+				return false;
+			}
+			madvise(m, size, MADV_SEQUENTIAL);
+			data = (const char *) m;
+		}
+		close(fd);
+		return true;
+	}
+};
+
+// Part of the input processed by one worker
+struct text_chunk {
+	size_t begin;    // first position a match may start at
+	size_t end;
+	size_t in_begin; // input range copied to the output (adjusted at the seams)
+	size_t in_end;
+	uint64_t out_offset;
+	std::vector<sshash::matcher::match> matches;
+};
+
+// Run f(i) for i in [0, n) on all workers
+template <typename F>
+static void parallel_for(size_t n, F f)
+{
+	std::atomic<size_t> next(0);
+	auto worker = [&]() {
+		for (size_t i; (i = next++) < n; )
+			f(i);
+	};
+
+	std::vector<std::thread> workers;
+	for (unsigned int i = 1; i < std::min<size_t>(opt_jobs, n); i++)
+		workers.emplace_back(worker);
+	worker();
+	for (auto &w : workers)
+		w.join();
+}
+
+// Generate output filename: <prefix><name><suffix><ext>
+static std::string output_filename(const std::string& infile)
+{
+	std::string name = infile, ext;
+	size_t slash = name.rfind('/');
+	size_t dot   = name.rfind('.');
+	if (dot != std::string::npos && (slash == std::string::npos || dot > slash + 1)) {
+		ext  = name.substr(dot);
+		name = name.substr(0, dot);
+	}
+
+	if (!opt_out_prefix.empty())
+		name = opt_out_prefix + (slash == std::string::npos ? name : name.substr(slash + 1));
+
+	return name + opt_out_suffix + ext;
+}
+
+// Replace strings in a text file.
+// The input is split into chunks that are searched in parallel. A chunk is
+// searched as if no match crossed into it from the previous one. When that
+// turns out to be wrong (a match from the previous chunk covers its start)
+// the chunk is searched again from the end of that match. Then the chunks are
+// rewritten in parallel, each at its own offset in the output file.
+static bool process_txt(const sshash::matcher& m, const std::string& infile)
+{
+	std::string outfile = output_filename(infile);
+	std::cout << "processing TXT " << infile << " -> " << outfile << "\n";
+
+	input_file f;
+	if (!f.map(infile))
+		return false;
+
+	std::vector<text_chunk> chunks;
+	for (uint64_t off = 0; off < f.size; off += opt_chunk_size) {
+		text_chunk c;
+		c.begin = off;
+		c.end   = std::min<uint64_t>(f.size, off + opt_chunk_size);
+		chunks.push_back(c);
+	}
+
+	parallel_for(chunks.size(), [&](size_t i) {
+		text_chunk &c = chunks[i];
+		m.find(f.data, f.size, c.begin, c.end, c.matches);
+	});
+
+	// Fix up the seams and lay out the output
+	size_t cursor = 0;  // end of the last match so far
+	uint64_t out_size = 0;
+	size_t nmatches = 0, nredo = 0;
+	for (auto &c : chunks) {
+		if (cursor > c.begin) {
+			c.matches.clear();
+			m.find(f.data, f.size, cursor, c.end, c.matches);
+			nredo++;
+		}
+
+		c.in_begin = std::max(c.begin, cursor);
+		if (!c.matches.empty())
+			cursor = c.matches.back().start + c.matches.back().len;
+		c.in_end = std::max(c.end, cursor);
+		if (c.in_begin > c.in_end)
+			c.in_begin = c.in_end;
+
+		uint64_t size = c.in_end - c.in_begin;
+		for (auto &x : c.matches)
+			size += m.replacement(x.id).size() - x.len;
+		c.out_offset = out_size;
+		out_size += size;
+		nmatches += c.matches.size();
+	}
+
+	int fd = open(outfile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		std::cerr << outfile << " open failed: " << strerror(errno) << "\n";
+		return false;
+	}
+	if (ftruncate(fd, out_size) < 0) {
+		std::cerr << outfile << " truncate failed: " << strerror(errno) << "\n";
+		close(fd);
+		return false;
+	}
+
+	std::atomic<bool> ok(true);
+	parallel_for(chunks.size(), [&](size_t i) {
+		text_chunk &c = chunks[i];
+		std::string out;
+		m.apply(f.data, c.in_begin, c.in_end, c.matches, out);
+		if (pwrite(fd, out.data(), out.size(), c.out_offset) != (ssize_t) out.size())
+			ok = false;
+	});
+
+	if (!ok || close(fd) < 0) {
+		std::cerr << outfile << " write failed: " << strerror(errno) << "\n";
+		return false;
+	}
+
+	if (opt_verbose)
+		std::cout << infile << ": " << nmatches << " replaced, " << chunks.size() << " chunks ("
+			<< nredo << " re-searched)\n";
+	return true;
+}
+
+// Rewrite JSON or XML document.
+// Documents are rewritten in a single streaming pass, see doc_rewriter.
+static bool process_doc(sshash::doc_rewriter& dr, const std::string& infile, bool xml)
+{
+	std::string outfile = output_filename(infile);
+	std::cout << "processing " << (xml ? "XML " : "JSON ") << infile << " -> " << outfile << "\n";
+
+	input_file f;
+	if (!f.map(infile))
+		return false;
+
+	sshash::out_file out;
+	if (!out.open(outfile))
+		return false;
+
+	size_t n = dr.replaced();
+	bool ok = xml ? dr.rewrite_xml(f.data, f.size, out) : dr.rewrite_json(f.data, f.size, out);
+	if (!ok)
+		std::cerr << infile << ": " << dr.error() << "\n";
+	if (!out.close())
+		ok = false;
+
+	if (ok && opt_verbose)
+		std::cout << infile << ": " << dr.replaced() - n << " replaced\n";
+	return ok;
+}
+
+// Figure out format from file extension
+static std::string file_format(const std::string& infile, const std::string& format)
+{
+	if (format != "auto")
+		return format;
+
+	size_t dot = infile.rfind('.');
+	std::string ext = dot == std::string::npos ? std::string() : infile.substr(dot);
+	if (ext == ".json" || ext == ".JSON")
+		return "json";
+	if (ext == ".xml" || ext == ".XML")
+		return "xml";
+	return "text";
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<std::string> input;
+
+	// **** Parse command line arguments ****
+	po::options_description optdesc("sshash-rewrite -- tool for hashing and unhashing sshash strings in text/json/xml files\n"
+				"Usage: sshash-rewrite <--hashmap map> [options] [input-files]\n"
+				"Options");
+	optdesc.add_options()
+		("help", "Print this message")
+		("input",      po::value<std::vector<std::string> >(&input)->composing(), "Input file. Multiple files can be specified.")
+		("hashmap,m",  po::value<std::string>(), "Hashmap file.")
+		("mode",       po::value<std::string>()->default_value("hash"), "hash or unhash")
+		("format",     po::value<std::string>()->default_value("auto"), "Format of the input files: auto/text/json/xml")
+		("out-prefix", po::value<std::string>(), "Prefix for output files")
+		("out-suffix", po::value<std::string>()->default_value("auto"), "Suffix for output files")
+		("minlen",     po::value<unsigned int>()->default_value(1), "Ignore strings shorter than this")
+		("jobs,j",     po::value<unsigned int>()->default_value(0), "Number of worker threads (0 - number of CPUs)")
+		("chunk-size", po::value<unsigned int>()->default_value(4096), "Input chunk size in KB")
+		("verbose",    "Show verbose info");
+
+	po::positional_options_description popt;
+	popt.add("input", -1);
+
+	po::store(po::command_line_parser(argc, argv).
+	          options(optdesc).positional(popt).run(), optmap);
+
+	po::notify(optmap);
+
+	if (optmap.count("help") || input.empty() || !optmap.count("hashmap")) {
+		std::cout << optdesc << std::endl;
+		return 1;
+	}
+
+	opt_verbose = optmap.count("verbose");
+	opt_jobs    = optmap["jobs"].as<unsigned int>();
+	if (!opt_jobs)
+		opt_jobs = std::max(1u, std::thread::hardware_concurrency());
+	opt_chunk_size = std::max(1u, optmap["chunk-size"].as<unsigned int>()) * 1024ull;
+
+	const std::string &mode = optmap["mode"].as<std::string>();
+	if (mode != "hash" && mode != "unhash") {
+		std::cerr << "unsupported mode: " << mode << "\n";
+		return 1;
+	}
+
+	if (optmap.count("out-prefix"))
+		opt_out_prefix = optmap["out-prefix"].as<std::string>();
+	opt_out_suffix = optmap["out-suffix"].as<std::string>();
+	if (opt_out_suffix == "auto")
+		opt_out_suffix = mode == "hash" ? ".hashed" : ".unhashed";
+
+	std::string format = optmap["format"].as<std::string>();
+	std::transform(format.begin(), format.end(), format.begin(), ::tolower);
+	if (format == "txt")
+		format = "text";
+	if (format != "auto" && format != "text" && format != "json" && format != "xml") {
+		std::cerr << "unsupported input format: " << format << "\n";
+		return 1;
+	}
+
+	sshash::map map;
+	if (!map.load(optmap["hashmap"].as<std::string>()))
+		return 1;
+
+	sshash::matcher m(map, mode == "hash" ? sshash::matcher::HASH : sshash::matcher::UNHASH,
+			optmap["minlen"].as<unsigned int>());
+	if (!m.valid()) {
+		std::cerr << "failed to build string matcher: too many strings\n";
+		return 1;
+	}
+
+	if (opt_verbose)
+		std::cout << "matcher: " << m.size() << " strings\n";
+
+	sshash::doc_rewriter dr(map, mode == "hash");
+
+	for (auto &i : input) {
+		std::string f = file_format(i, format);
+		bool ok = f == "text" ? process_txt(m, i) : process_doc(dr, i, f == "xml");
+		if (!ok)
+			return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,119 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef SSHASH_STRING_PARSER
+#define SSHASH_STRING_PARSER
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+namespace sshash {
+
+// Parse sshash padded strings from an ELF section.
+// Each string is followed by NUL padding (compact layout) or by NULs,
+// a run of '~' and more NULs (legacy layout). The room for the digest
+// covers the string and all of its padding.
+class string_parser {
+public:
+	// Read the section from a file
+	string_parser(int fd, uint64_t sect_offset, uint64_t sect_size)
+		: _start(sect_offset), _offset(0)
+	{
+		_data.resize(sect_size);
+		_failed = pread(fd, &_data[0], sect_size, sect_offset) != (ssize_t) sect_size;
+		_d = _data.data();
+		_n = _data.size();
+	}
+
+	// Parse a section that is already in memory (offsets are relative to 'start')
+	string_parser(const char *data, size_t size, uint64_t start)
+		: _start(start), _offset(0), _failed(false), _d(data), _n(size)
+	{}
+
+	bool failed() const { return _failed; }
+
+	// Get the next string
+	// Returns content, offset and room till next string
+	bool next(std::string& str, uint64_t& offset, size_t& room)
+	{
+		const char *d = _d;
+		const size_t n = _n;
+
+		// Skip empty strings
+		size_t i = skip_zeros(_offset);
+		if (i == n)
+			return false;
+
+		// Main string
+		const char *z = (const char *) memchr(d + i, '\0', n - i);
+		size_t e = z ? z - d : n;
+		str.assign(d + i, e - i);
+		offset = _start + i;
+
+		e = skip_zeros(e);
+
+		// Legacy sshash pad
+		if (e < n && d[e] == '~') {
+			size_t p = e;
+			while (p < n && d[p] == '~')
+				p++;
+			if (p == n || d[p] == '\0')
+				e = skip_zeros(p);
+		}
+
+		room = e - i;
+		_offset = e;
+		return true;
+	}
+
+private:
+	size_t skip_zeros(size_t i) const
+	{
+		while (i < _n && _d[i] == '\0')
+			i++;
+		return i;
+	}
+
+	uint64_t _start;
+	size_t   _offset;
+	bool     _failed;
+
+	std::vector<char> _data; // section read from a file
+	const char *_d;
+	size_t      _n;
+};
+
+} // namespace sshash
+
+#endif // SSHASH_STRING_PARSER
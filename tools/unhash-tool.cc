@@ -0,0 +1,418 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <iostream>
+#include <streambuf>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <hogl/format-raw.hpp>
+
+#include "sshash/resolver.hpp"
+#include "ssformat.hpp"
+
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+static po::variables_map optmap;
+
+static unsigned int opt_jobs = 1;
+static unsigned int opt_chunk = 4096;
+
+// String ID table shared by all workers (optional)
+static std::shared_ptr<const sshash::id_table> string_ids;
+
+// Raw log mapped into memory
+struct raw_file {
+	std::string name;
+	const char *data;
+	size_t      size;
+
+	raw_file() : data(nullptr), size(0) {}
+	~raw_file() { if (data) munmap((void *) data, size); }
+
+	bool map(const std::string& n)
+	{
+		name = n;
+		int fd = open(name.c_str(), O_RDONLY);
+		if (fd < 0) {
+			std::cerr << name << " open failed: " << strerror(errno) << "\n";
+			return false;
+		}
+
+		struct stat st;
+		if (fstat(fd, &st) < 0) {
+			std::cerr << name << " stat failed: " << strerror(errno) << "\n";
+			close(fd);
+			return false;
+		}
+
+		size = st.st_size;
+		if (size) {
+			void *m = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+			if (m == MAP_FAILED) {
+				std::cerr << name << " mmap failed: " << strerror(errno) << "\n";
+				close(fd);
+				return false;
+			}
+			madvise(m, size, MADV_SEQUENTIAL);
+			data = (const char *) m;
+		}
+		close(fd);
+		return true;
+	}
+};
+
+// Read-only stream buffer over the mapped log (no copies)
+class raw_streambuf : public std::streambuf {
+public:
+	raw_streambuf(const char *data, size_t size)
+	{
+		char *p = const_cast<char *>(data);
+		setg(p, p, p + size);
+	}
+
+	// Read position (like tellg(), but also valid once the stream hit the end)
+	uint64_t pos() const { return gptr() - eback(); }
+};
+
+// Stream buffer over a chunk of the mapped log: the log header (whatever the parser
+// reads before the first record) followed by the records of the chunk.
+// A parser created over it sees a complete log with just these records.
+class chunk_streambuf : public std::streambuf {
+public:
+	chunk_streambuf(const char *data, size_t hdr_size, size_t begin, size_t end) :
+		_data(const_cast<char *>(data)), _begin(begin), _end(end)
+	{
+		if (hdr_size)
+			setg(_data, _data, _data + hdr_size);
+		else
+			set_chunk();
+	}
+
+protected:
+	int_type underflow() override
+	{
+		if (gptr() < egptr())
+			return traits_type::to_int_type(*gptr());
+		if (eback() != _data + _begin && _begin < _end) {
+			set_chunk();
+			return traits_type::to_int_type(*gptr());
+		}
+		return traits_type::eof();
+	}
+
+private:
+	void set_chunk() { setg(_data + _begin, _data + _begin, _data + _end); }
+
+	char  *_data;
+	size_t _begin;
+	size_t _end;
+};
+
+// Decoded chunks, written out in the original order.
+// Chunk k covers records [k * opt_chunk, (k + 1) * opt_chunk) and is decoded
+// by worker k % njobs. Workers stay at most 'window' chunks ahead of the writer,
+// which bounds the memory used for buffered output.
+class chunk_queue {
+public:
+	chunk_queue(unsigned int window) :
+		_slots(window), _ready(window, false), _written(0), _nchunks(UINT64_MAX)
+	{}
+
+	// Wait for room for chunk k
+	void wait_room(uint64_t k)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		while (k >= _written + _slots.size())
+			_cond.wait(lock);
+	}
+
+	// Chunk k is decoded
+	void put(uint64_t k, std::string& out)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		unsigned int i = k % _slots.size();
+		_slots[i].swap(out);
+		_ready[i] = true;
+		_cond.notify_all();
+	}
+
+	// Total number of chunks is known (end of input)
+	void set_total(uint64_t n)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_nchunks = n;
+		_cond.notify_all();
+	}
+
+	// Write chunks in order until all of them are written
+	bool write_all(FILE *f)
+	{
+		std::string out;
+		bool ok = true;
+		for (uint64_t k = 0; ; k++) {
+			unsigned int i = k % _slots.size();
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				while (!_ready[i] && k < _nchunks)
+					_cond.wait(lock);
+				if (!_ready[i])
+					break;
+				out.swap(_slots[i]);
+				_ready[i] = false;
+			}
+
+			if (ok && fwrite(out.data(), 1, out.size(), f) != out.size())
+				ok = false;
+			out.clear();
+
+			std::unique_lock<std::mutex> lock(_mutex);
+			_written = k + 1;
+			_cond.notify_all();
+		}
+		return ok;
+	}
+
+private:
+	std::mutex               _mutex;
+	std::condition_variable  _cond;
+	std::vector<std::string> _slots;
+	std::vector<bool>        _ready;
+	uint64_t                 _written; // chunks written so far
+	uint64_t                 _nchunks; // total number of chunks (once known)
+};
+
+// Record layout of a raw log, found by a sequential pre-scan.
+// The raw format has no sync markers, so chunks cannot be located by looking
+// at the data. One pass over the log (parsing only, no formatting) records the
+// stream offset of every opt_chunk-th record, then each worker parses only its
+// own chunks.
+struct raw_layout {
+	size_t                hdr_size; // log header, read by the parser before the first record
+	std::vector<uint64_t> offset;   // offset[k]: start of chunk k, offset[nchunks]: end of the last record
+
+	uint64_t nchunks() const { return offset.empty() ? 0 : offset.size() - 1; }
+};
+
+static bool scan_layout(const raw_file& f, raw_layout& l)
+{
+	raw_streambuf buf(f.data, f.size);
+	std::istream in(&buf);
+
+	l.hdr_size = 0;
+	l.offset.clear();
+	if (!f.size)
+		return true;
+
+	std::unique_ptr<hogl::format_raw::parser> parser(hogl::format_raw::parser::create(in));
+	if (!parser) {
+		std::cerr << f.name << ": not a hogl raw log\n";
+		return false;
+	}
+
+	uint64_t pos = buf.pos();
+	l.hdr_size = pos;
+
+	uint64_t n = 0;
+	while (parser->next()) {
+		if (n++ % opt_chunk == 0)
+			l.offset.push_back(pos);
+		pos = buf.pos();
+	}
+	if (n)
+		l.offset.push_back(pos);
+	return true;
+}
+
+// Decode worker: formats chunks id, id + njobs, id + 2 * njobs, ...
+// Each chunk gets its own parser that starts at the first record of the chunk.
+static void unhash_worker(const raw_file& f, const raw_layout& l, sshash::resolver& res, chunk_queue& q,
+		unsigned int id, sshash::decode_stats& stats)
+{
+	sshash::ssformat fmt(res, optmap["format"].as<std::string>(), optmap.count("substr"), optmap.count("stats"));
+	fmt.set_ids(string_ids);
+	sshash::ostrbuf_str sb;
+
+	for (uint64_t k = id; k < l.nchunks(); k += opt_jobs) {
+		q.wait_room(k);
+
+		chunk_streambuf buf(f.data, l.hdr_size, l.offset[k], l.offset[k + 1]);
+		std::istream in(&buf);
+		std::unique_ptr<hogl::format_raw::parser> parser(hogl::format_raw::parser::create(in));
+
+		const hogl::format::data *d;
+		for (unsigned int i = 0; parser && i < opt_chunk && (d = parser->next()); i++)
+			fmt.process(sb, *d);
+
+		// The cached strings belong to this parser, the next one may reuse their addresses
+		fmt.reset_caches();
+
+		sb.flush();
+		q.put(k, sb.str);
+		sb.str.clear();
+	}
+
+	stats = fmt.stats();
+}
+
+// Unhash one raw log
+static bool unhash_file(sshash::resolver& res, const std::string& infile, FILE *out, sshash::decode_stats& stats)
+{
+	raw_file f;
+	if (!f.map(infile))
+		return false;
+
+	raw_layout l;
+	if (!scan_layout(f, l))
+		return false;
+
+	chunk_queue q(opt_jobs * 2);
+	q.set_total(l.nchunks());
+	std::vector<sshash::decode_stats> wstats(opt_jobs);
+	std::vector<std::thread> workers;
+	for (unsigned int i = 0; i < opt_jobs; i++)
+		workers.emplace_back(unhash_worker, std::cref(f), std::cref(l), std::ref(res), std::ref(q), i, std::ref(wstats[i]));
+
+	bool ok = q.write_all(out);
+
+	for (auto &w : workers)
+		w.join();
+	for (auto &s : wstats)
+		stats.merge(s);
+
+	if (!ok)
+		std::cerr << infile << ": write failed: " << strerror(errno) << "\n";
+	return ok;
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<std::string> input;
+
+	// **** Parse command line arguments ****
+	po::options_description optdesc("sshash-unhash -- tool for decoding hogl raw logs with sshash strings\n"
+				"Usage: sshash-unhash <--hashmap map> [options] [raw-log-files]\n"
+				"Options");
+	optdesc.add_options()
+		("help", "Print this message")
+		("input",     po::value<std::vector<std::string> >(&input)->composing(), "Input raw log file. Multiple files can be specified.")
+		("hashmap,m", po::value<std::string>(), "Hashmap file.")
+		("format,f",  po::value<std::string>()->default_value("fast1"), "Hogl format spec")
+		("output,o",  po::value<std::string>(), "Output file (default stdout)")
+		("substr",    "Also replace digests embedded inside strings")
+		("ids",       po::value<std::string>(), "String ID table (written by sshash-elf --ids)")
+		("jobs,j",    po::value<unsigned int>()->default_value(0), "Number of worker threads (0 - number of CPUs)")
+		("chunk",     po::value<unsigned int>()->default_value(4096), "Number of records per chunk")
+		("stats",     po::value<std::string>(), "Append decode stats as JSON to this file (\"-\" for stderr)");
+
+	po::positional_options_description popt;
+	popt.add("input", -1);
+
+	po::store(po::command_line_parser(argc, argv).
+	          options(optdesc).positional(popt).run(), optmap);
+
+	po::notify(optmap);
+
+	if (optmap.count("help") || input.empty() || !optmap.count("hashmap")) {
+		std::cout << optdesc << std::endl;
+		return 1;
+	}
+
+	opt_jobs = optmap["jobs"].as<unsigned int>();
+	if (!opt_jobs)
+		opt_jobs = std::max(1u, std::thread::hardware_concurrency());
+	opt_chunk = std::max(1u, optmap["chunk"].as<unsigned int>());
+
+	// Single map shared by all workers
+	sshash::resolver res;
+	if (!res.load(optmap["hashmap"].as<std::string>()))
+		return 1;
+
+	if (optmap.count("ids")) {
+		std::shared_ptr<sshash::id_table> t(new sshash::id_table);
+		if (!sshash::load_ids(optmap["ids"].as<std::string>(), *t))
+			return 1;
+		string_ids = t;
+	}
+
+	FILE *out = stdout;
+	if (optmap.count("output")) {
+		const std::string &name = optmap["output"].as<std::string>();
+		out = fopen(name.c_str(), "w");
+		if (!out) {
+			std::cerr << name << " open failed: " << strerror(errno) << "\n";
+			return 1;
+		}
+	}
+
+	sshash::decode_stats stats;
+	memset(&stats, 0, sizeof(stats));
+
+	bool ok = true;
+	for (auto &i : input) {
+		if (!unhash_file(res, i, out, stats)) {
+			ok = false;
+			break;
+		}
+	}
+
+	if (fflush(out) || (out != stdout && fclose(out))) {
+		std::cerr << "output write failed: " << strerror(errno) << "\n";
+		ok = false;
+	}
+
+	if (optmap.count("stats")) {
+		const std::string &name = optmap["stats"].as<std::string>();
+		FILE *f = name == "-" ? stderr : fopen(name.c_str(), "a");
+		if (!f) {
+			std::cerr << name << " open failed: " << strerror(errno) << "\n";
+			return 1;
+		}
+		stats.dump(f);
+		if (f != stderr)
+			fclose(f);
+	}
+
+	return ok ? 0 : 1;
+}
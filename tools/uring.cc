@@ -0,0 +1,271 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <algorithm>
+
+#include "uring.hpp"
+
+#ifdef SSHASH_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+namespace sshash {
+
+#ifdef SSHASH_IO_URING
+
+struct uring::sqe : io_uring_sqe {};
+struct uring::cqe : io_uring_cqe {};
+
+static int sys_io_uring_setup(unsigned int entries, io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned int opcode, void *arg, unsigned int nargs)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nargs);
+}
+
+uring::uring() :
+	_fd(-1), _entries(0), _inflight(0), _queued(0),
+	_sq_ptr(MAP_FAILED), _sq_size(0), _cq_ptr(MAP_FAILED), _cq_size(0), _sqes((sqe *) MAP_FAILED), _sqes_size(0)
+{}
+
+uring::~uring()
+{
+	if (_sqes != MAP_FAILED)
+		munmap(_sqes, _sqes_size);
+	if (_cq_ptr != MAP_FAILED && _cq_ptr != _sq_ptr)
+		munmap(_cq_ptr, _cq_size);
+	if (_sq_ptr != MAP_FAILED)
+		munmap(_sq_ptr, _sq_size);
+	if (_fd >= 0)
+		::close(_fd);
+}
+
+bool uring::init(unsigned int entries)
+{
+	io_uring_params p;
+	memset(&p, 0, sizeof(p));
+
+	_fd = sys_io_uring_setup(entries, &p);
+	if (_fd < 0)
+		return false;
+
+	// Make sure that all operations we need are supported
+	uint64_t probe_buf[(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op)) / 8 + 1];
+	memset(probe_buf, 0, sizeof(probe_buf));
+	io_uring_probe *probe = (io_uring_probe *) probe_buf;
+	if (sys_io_uring_register(_fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+		return false;
+	for (unsigned int op : { IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE }) {
+		if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+			return false;
+	}
+
+	// Map the rings
+	_sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	_cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		_sq_size = _cq_size = std::max(_sq_size, _cq_size);
+
+	_sq_ptr = mmap(NULL, _sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+	if (_sq_ptr == MAP_FAILED)
+		return false;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		_cq_ptr = _sq_ptr;
+	else {
+		_cq_ptr = mmap(NULL, _cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+		if (_cq_ptr == MAP_FAILED)
+			return false;
+	}
+
+	_sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+	_sqes = (sqe *) mmap(NULL, _sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+	if (_sqes == MAP_FAILED)
+		return false;
+
+	char *sq = (char *) _sq_ptr;
+	_sq_head  = (unsigned *) (sq + p.sq_off.head);
+	_sq_tail  = (unsigned *) (sq + p.sq_off.tail);
+	_sq_mask  = (unsigned *) (sq + p.sq_off.ring_mask);
+	_sq_array = (unsigned *) (sq + p.sq_off.array);
+	_sq_local_tail = *_sq_tail;
+
+	char *cq = (char *) _cq_ptr;
+	_cq_head = (unsigned *) (cq + p.cq_off.head);
+	_cq_tail = (unsigned *) (cq + p.cq_off.tail);
+	_cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+	_cqes    = (cqe *) (cq + p.cq_off.cqes);
+
+	// Completion queue is at least as large as the submission queue, keeping the number
+	// of operations in flight under the submission queue size never overflows it
+	_entries = p.sq_entries;
+	return true;
+}
+
+unsigned int uring::space() const
+{
+	return _entries - _inflight - _queued;
+}
+
+uring::sqe* uring::get_sqe()
+{
+	if (!space())
+		return nullptr;
+
+	unsigned idx = _sq_local_tail & *_sq_mask;
+	sqe *e = &_sqes[idx];
+	memset(e, 0, sizeof(*e));
+	_sq_array[idx] = idx;
+	_sq_local_tail++;
+	_queued++;
+	return e;
+}
+
+bool uring::openat(int dfd, const char *path, int flags, uint64_t user_data)
+{
+	sqe *e = get_sqe();
+	if (!e)
+		return false;
+	e->opcode    = IORING_OP_OPENAT;
+	e->fd        = dfd;
+	e->addr      = (uint64_t) (uintptr_t) path;
+	e->open_flags = flags;
+	e->user_data = user_data;
+	return true;
+}
+
+bool uring::read(int fd, void *buf, unsigned int len, uint64_t offset, uint64_t user_data)
+{
+	sqe *e = get_sqe();
+	if (!e)
+		return false;
+	e->opcode    = IORING_OP_READ;
+	e->fd        = fd;
+	e->addr      = (uint64_t) (uintptr_t) buf;
+	e->len       = len;
+	e->off       = offset;
+	e->user_data = user_data;
+	return true;
+}
+
+bool uring::write(int fd, const void *buf, unsigned int len, uint64_t offset, uint64_t user_data)
+{
+	sqe *e = get_sqe();
+	if (!e)
+		return false;
+	e->opcode    = IORING_OP_WRITE;
+	e->fd        = fd;
+	e->addr      = (uint64_t) (uintptr_t) buf;
+	e->len       = len;
+	e->off       = offset;
+	e->user_data = user_data;
+	return true;
+}
+
+bool uring::close(int fd, uint64_t user_data)
+{
+	sqe *e = get_sqe();
+	if (!e)
+		return false;
+	e->opcode    = IORING_OP_CLOSE;
+	e->fd        = fd;
+	e->user_data = user_data;
+	return true;
+}
+
+int uring::submit(completion *out, unsigned int max, bool wait)
+{
+	// Publish queued entries
+	__atomic_store_n(_sq_tail, _sq_local_tail, __ATOMIC_RELEASE);
+
+	// Reap what is already there before blocking
+	unsigned head = *_cq_head;
+	bool ready = head != __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+
+	if (_queued || (wait && !ready)) {
+		unsigned flags = wait && !ready ? IORING_ENTER_GETEVENTS : 0;
+		int r;
+		do {
+			r = sys_io_uring_enter(_fd, _queued, wait && !ready ? 1 : 0, flags);
+		} while (r < 0 && errno == EINTR);
+		if (r < 0)
+			return -errno;
+		_inflight += r;
+		_queued   -= r;
+	}
+
+	unsigned int n = 0;
+	head = *_cq_head;
+	unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+	for (; head != tail && n < max; head++, n++) {
+		const cqe &c = _cqes[head & *_cq_mask];
+		out[n].user_data = c.user_data;
+		out[n].res       = c.res;
+	}
+	__atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+	_inflight -= n;
+	return n;
+}
+
+#else // SSHASH_IO_URING
+
+struct uring::sqe {};
+struct uring::cqe {};
+
+uring::uring() : _fd(-1), _entries(0), _inflight(0), _queued(0) {}
+uring::~uring() {}
+
+bool uring::init(unsigned int) { return false; }
+unsigned int uring::space() const { return 0; }
+uring::sqe* uring::get_sqe() { return nullptr; }
+
+bool uring::openat(int, const char *, int, uint64_t) { return false; }
+bool uring::read(int, void *, unsigned int, uint64_t, uint64_t) { return false; }
+bool uring::write(int, const void *, unsigned int, uint64_t, uint64_t) { return false; }
+bool uring::close(int, uint64_t) { return false; }
+int  uring::submit(completion *, unsigned int, bool) { return -ENOSYS; }
+
+#endif // SSHASH_IO_URING
+
+} // namespace sshash
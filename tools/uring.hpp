@@ -0,0 +1,118 @@
+//  Copyright (c) 2021, Qualcomm Innovation Center, Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice,
+//     this list of conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//     this list of conditions and the following disclaimer in the documentation
+//     and/or other materials provided with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors
+//     may be used to endorse or promote products derived from this software
+//     without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+//  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+//  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+//  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+//  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+//  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+//  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+//  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+//  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+//  SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef SSHASH_URING
+#define SSHASH_URING
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace sshash {
+
+// Minimal io_uring wrapper (raw syscalls, no liburing).
+// Supports the few operations needed for batch file I/O. All methods are
+// called from a single thread. If io_uring is not available (old kernel,
+// seccomp, built without SSHASH_IO_URING) init() fails and the caller falls
+// back to blocking I/O.
+class uring {
+public:
+	// Completed operation
+	struct completion {
+		uint64_t user_data;
+		int      res; // result or -errno
+	};
+
+	uring();
+	~uring();
+
+	/**
+	 * Setup the ring
+	 * @param entries submission queue size (power of 2)
+	 * @return false if io_uring or one of the required operations is not supported
+	 */
+	bool init(unsigned int entries);
+
+	// Number of operations that can be queued before the next submit
+	unsigned int space() const;
+
+	// Queue operations (return false if the submission queue is full)
+	bool openat(int dfd, const char *path, int flags, uint64_t user_data);
+	bool read(int fd, void *buf, unsigned int len, uint64_t offset, uint64_t user_data);
+	bool write(int fd, const void *buf, unsigned int len, uint64_t offset, uint64_t user_data);
+	bool close(int fd, uint64_t user_data);
+
+	/**
+	 * Submit queued operations and reap completions
+	 * @param out completion buffer
+	 * @param max size of the completion buffer
+	 * @param wait block until at least one completion is available
+	 * @return number of completions, or -errno
+	 */
+	int submit(completion *out, unsigned int max, bool wait);
+
+	// Number of operations submitted but not completed yet
+	unsigned int inflight() const { return _inflight; }
+
+	// Submission queue size
+	unsigned int entries() const { return _entries; }
+
+private:
+	struct sqe;
+	struct cqe;
+
+	sqe* get_sqe();
+
+	int       _fd;
+	unsigned  _entries;
+	unsigned  _inflight;
+	unsigned  _queued;    // queued but not submitted yet
+
+	void     *_sq_ptr;
+	size_t    _sq_size;
+	void     *_cq_ptr;
+	size_t    _cq_size;
+	sqe      *_sqes;
+	size_t    _sqes_size;
+
+	unsigned *_sq_head;
+	unsigned *_sq_tail;
+	unsigned *_sq_mask;
+	unsigned *_sq_array;
+	unsigned  _sq_local_tail;
+
+	unsigned *_cq_head;
+	unsigned *_cq_tail;
+	unsigned *_cq_mask;
+	cqe      *_cqes;
+};
+
+} // namespace sshash
+
+#endif // SSHASH_URING